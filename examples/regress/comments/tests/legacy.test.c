@@ -0,0 +1,8 @@
+//not using TOAST(name) { ... } here, neither in "TOAST(name)"
+/* void ghost(BurntToast *burnt) { } */
+void plain(BurntToast *burnt) {
+    const char *text = "TOAST(no) { void not_a_case(";
+    if (text[0] == 'T' && '}' == '}') {
+        eat_toast(burnt);
+    }
+}
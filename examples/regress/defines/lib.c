@@ -0,0 +1,6 @@
+int counter;
+
+int add(int a, int b) {
+    counter++;
+    return a + b;
+}
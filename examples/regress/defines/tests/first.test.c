@@ -0,0 +1,7 @@
+TOAST(first_adds) {
+    if (add(1, 2) == 3) {
+        eat_toast(burnt);
+        return;
+    }
+    burn_toast(burnt, "1 + 2 isn't 3");
+}
@@ -0,0 +1,8 @@
+void second_adds(BurntToast *burnt) {
+    int before = counter;
+    if (add(2, 2) == 4 && counter == before + 1) {
+        eat_toast(burnt);
+        return;
+    }
+    burn_toast(burnt, "2 + 2 isn't 4");
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+static inline int answer(void) {
+    return 42;
+}
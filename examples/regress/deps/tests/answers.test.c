@@ -0,0 +1,7 @@
+TOAST(answers) {
+    if (answer() == 42) {
+        eat_toast(burnt);
+        return;
+    }
+    burn_toast(burnt, "the answer changed");
+}
@@ -0,0 +1 @@
+#include "answer.h"
@@ -0,0 +1,7 @@
+void plain_answers(BurntToast *burnt) {
+    if (answer() == 42) {
+        eat_toast(burnt);
+        return;
+    }
+    burn_toast(burnt, "the answer changed");
+}
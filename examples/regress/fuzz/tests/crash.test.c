@@ -0,0 +1,14 @@
+TOAST(before) {
+    eat_toast(burnt);
+}
+
+TOAST_FUZZ(crashes) {
+    (void)burnt;
+    if (len > 0 && data[0] == 'h') {
+        *(volatile int*)0 = 1;
+    }
+}
+
+TOAST(after) {
+    eat_toast(burnt);
+}
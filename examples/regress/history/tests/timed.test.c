@@ -0,0 +1,3 @@
+void timed(BurntToast *burnt) {
+    eat_toast(burnt);
+}
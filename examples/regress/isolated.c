@@ -0,0 +1,102 @@
+/*
+Isolated runs checked from the outside: `isolated rows`, `isolated diagnostics`
+and `isolated flood` exit with 1 if toast got them wrong.
+*/
+#define TOAST_IMPLEMENTATION
+#include "toast.h"
+#include <signal.h>
+
+static int rows[2*ROW_BATCH] = {0};
+
+void row_crash(BurntToast *burnt, const void *row) {
+    if (row == &rows[2]) {
+        raise(SIGABRT);
+    }
+    eat_toast(burnt);
+}
+
+static int flood[20000] = {0};
+
+void flood_crash(BurntToast *burnt, const void *row) {
+    if (row == &flood[19000]) {
+        raise(SIGSEGV);
+    }
+    eat_toast(burnt);
+}
+
+void crashes(BurntToast *burnt) {
+    (void)burnt;
+    raise(SIGSEGV);
+}
+
+void burns(BurntToast *burnt) {
+    burn_toast(burnt, "burnt on purpose");
+}
+
+//Counts the rows by outcome as they are reported
+typedef struct {
+    ToastReporter reporter;
+    size_t passed;
+    size_t burnt;
+} RowCount;
+
+void count_row(ToastReporter *self, size_t index, SliceOfToast *slice) {
+    (void)index;
+    RowCount *count = (RowCount*)self;
+    count->passed += slice->result == YUMMY;
+    count->burnt += slice->result == BURNT;
+}
+
+//A worker dying on a row mustn't take the rest of its batch with it
+int check_rows(void) {
+    PackOfToast pack = plug_in_toaster("rows");
+    static ToastRows r = TOAST_ROWS(rows);
+    insert_toast(&pack, pre_bake_params("row_crash", row_crash, &r));
+    //unplug_toaster frees the reporter
+    RowCount *count = calloc(1, sizeof(RowCount));
+    count->reporter.report = count_row;
+    pack.reporter = &count->reporter;
+    toast_isolated(pack, 1);
+    int ok = count->passed == 2*ROW_BATCH - 1 && count->burnt == 1;
+    unplug_toaster(pack);
+    return ok;
+}
+
+//Diagnostics of the workers outlive the table they were reported in
+int check_diagnostics(void) {
+    PackOfToast pack = plug_in_toaster("diagnostics");
+    insert_toast(&pack, pre_bake_toast("crashes", crashes));
+    insert_toast(&pack, pre_bake_toast("burns", burns));
+    toast_isolated(pack, 2);
+    const char *crashed = pack.slices[0].diagnostic, *burnt = pack.slices[1].diagnostic;
+    int ok = crashed != NULL && strstr(crashed, "SIGSEGV") != NULL 
+        && burnt != NULL && strcmp(burnt, "burnt on purpose") == 0;
+    unplug_toaster(pack);
+    return ok;
+}
+
+//A worker dying while the runner is stuck printing mustn't deadlock it, run
+//with a stdout that is slow to read
+int check_flood(void) {
+    PackOfToast pack = plug_in_toaster("flood");
+    static ToastRows r = TOAST_ROWS(flood);
+    insert_toast(&pack, pre_bake_params("flood_crash", flood_crash, &r));
+    toast_isolated(pack, 8);
+    int ok = pack.slices[0].result == BURNT;
+    unplug_toaster(pack);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 2 && strcmp(argv[1], "rows") == 0) {
+        return check_rows() ? 0 : 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "diagnostics") == 0) {
+        return check_diagnostics() ? 0 : 1;
+    }
+    if (argc == 2 && strcmp(argv[1], "flood") == 0) {
+        return check_flood() ? 0 : 1;
+    }
+    fprintf(stderr, "usage: %s rows|diagnostics|flood\n", argv[0]);
+    return 1;
+}
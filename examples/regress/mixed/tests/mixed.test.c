@@ -0,0 +1,13 @@
+static void check(BurntToast *burnt, int ok) {
+    if (ok) {
+        eat_toast(burnt);
+    }
+}
+
+TOAST(macro) {
+    check(burnt, 1);
+}
+
+void plain(BurntToast *burnt) {
+    eat_toast(burnt);
+}
@@ -0,0 +1,142 @@
+#!/bin/sh
+# Regression cases of toaster and toast.h. Every directory here is a small
+# project, it is copied into a scratch directory and toasted there.
+# Usage: run.sh <toaster> <toast.h>, exits with 1 if any case failed.
+set -u
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <toaster> <toast.h>"
+    exit 1
+fi
+here=$(cd "$(dirname "$0")" && pwd)
+toaster=$(cd "$(dirname "$1")" && pwd)/$(basename "$1")
+header=$(cd "$(dirname "$2")" && pwd)/$(basename "$2")
+scratch=$(mktemp -d)
+trap 'rm -rf "$scratch"' EXIT
+failed=0
+
+# Copies the project [1] into the scratch directory and enters it
+enter() {
+    cp -r "$here/$1" "$scratch/$1"
+    cp "$header" "$scratch/$1/"
+    cd "$scratch/$1" || exit 1
+}
+
+# Runs toaster with the given arguments, its output goes to ./out and its
+# exit status to $status
+toast() {
+    "$toaster" "$@" > out 2>&1
+    status=$?
+}
+
+# Reports the case [1], it passed if the rest of the arguments succeed
+check() {
+    name=$1
+    shift
+    if "$@" > /dev/null 2>&1; then
+        echo "[REGRESS] $name"
+    else
+        echo "[REGRESS][ERROR] $name"
+        failed=1
+    fi
+}
+
+# Whether the overview lists case [1] with outcome [2]
+outcome() {
+    grep -Eq "\| $1 +\| $2 " out
+}
+
+absent() {
+    ! grep -q "$1" out
+}
+
+# Headers included through defin.test.c are part of the cache and memo keys
+enter deps
+toast
+check "deps: both cases pass" outcome answers pass
+check "deps: both cases pass" outcome plain_answers pass
+sed -i 's/42/41/' answer.h
+toast
+check "deps: a changed header rebuilds" grep -q "Compilation successful" out
+check "deps: a changed header isn't served from the memo" outcome answers fail
+check "deps: a changed header isn't served from the memo" outcome plain_answers fail
+sed -i 's/41/42/' answer.h
+toast
+check "deps: the build of the old header is reused" grep -q "Sources unchanged" out
+check "deps: the passes of the old header are served" outcome answers cached
+toast -- --timeout 10000
+check "deps: a pass without a timeout isn't served with one" outcome answers pass
+toast -- --timeout 10000
+check "deps: a pass with the same timeout is" outcome answers cached
+
+# What defin.test.c defines is linked once, however many files include it
+enter defines
+toast
+check "defines: the test files link" outcome first_adds pass
+check "defines: the test files link" outcome second_adds pass
+
+# Reporters are named in full
+toast -r jsonlx
+check "reporter: a longer kind is refused" grep -q "Expected a reporter of kind 'jsonl' or 'junit', got 'jsonlx'" out
+toast -r junit:report.xml
+check "reporter: a kind with a path is accepted" test -s report.xml
+
+# Mentions of the macros in comments and strings don't change how a file is
+# compiled, neither do cases commented out
+enter comments
+toast
+check "comments: the plain case runs" outcome plain pass
+check "comments: commented out cases don't" absent ghost
+toast -k
+check "comments: kept sources stay in the cache" test ! -e tmp_toast.c
+check "comments: kept sources stay in the cache" grep -lq "int main" .toast_cache/src/*.c
+
+# Plain cases in a file using the macros would never run
+enter mixed
+toast
+check "mixed: toaster fails" test $status -ne 0
+check "mixed: the file and the case are named" grep -q "mixed.test.c' defines cases with TOAST() and 'plain'" out
+
+# A crashing fuzz target only takes its isolated worker down
+enter fuzz
+toast -i -- --fuzz-seed 1
+check "fuzz: the runner outlives the target" grep -q "Toasts are done" out
+check "fuzz: the target fails" outcome crashes fail
+check "fuzz: the tests pass" outcome after pass
+check "fuzz: the input is saved" grep -q "Saved to: *crash-crashes-" out
+
+# Allocations are tracked by the runtime, a prebuilt one can't be told to
+toast -A -l toast.h
+check "libtoast: -A is refused with a prebuilt libtoast" grep -q "doesn't track allocations with a prebuilt libtoast" out
+
+# Revisions are kept whole in the history
+enter history
+sha=0123456789abcdef0123456789abcdef01234567
+for run in 1 2 3 4 5; do
+    toast -n -- --revision $sha
+done
+toast -n -R 5 -- --baseline $sha
+check "history: a full SHA is a baseline" grep -q "Compared 1 of 1" out
+toast -n -R 5 -- --baseline 0123456789abcdef0123456789abcdef0123456
+check "history: its prefix is not" grep -q "Compared 0 of 1" out
+toast -R 5
+toast -R 5
+check "history: passes aren't served while comparing" grep -q "Compared 1 of 1" out
+for shard in 1 2 3 4 5 6 7 8; do
+    "$toaster" -H shards -- --shard $shard/8 > /dev/null 2>&1 &
+done
+wait
+check "history: shards starting it at once write one header" test "$(grep -ao TOASTHI1 shards | wc -l)" -eq 1
+
+# Isolated runs of a pack built by hand, see isolated.c
+cd "$scratch" || exit 1
+cp "$header" "$here/isolated.c" .
+if ${CC:-cc} -Wall -Wextra -pthread isolated.c -o isolated > out 2>&1; then
+    check "isolated: a crash doesn't lose the rows of its batch" ./isolated rows
+    check "isolated: diagnostics outlive the run" ./isolated diagnostics
+    check "isolated: a dead worker doesn't deadlock a busy runner" \
+        timeout 60 sh -c './isolated flood | (sleep 2; cat > /dev/null)'
+else
+    check "isolated: compiles" false
+fi
+
+exit $failed
@@ -8,18 +8,43 @@ for the C programming language.
 #ifndef TOAST_H_
 #define TOAST_H_
 
+//has to come before the first system header, files only using the
+//declarations are left as they are
+#if defined(TOAST_IMPLEMENTATION) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE //for RUSAGE_THREAD
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
+#include <stddef.h>
 #include <sys/time.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #define INITIAL_SLOTS 2 // has to be two because of standard toasters
 #define ERROR_BUFFER_CAP 1024
 #define YUMMY 0 //means success
 #define BURNT 1 //means failure
 #define RAW -1  //means unexecuted
+#define AUTO_JOBS 0 //one worker per online core
+#define BENCH_TIME_NS 100000000 //time a benchmark is sampled for, 100ms
+#define BENCH_SAMPLES 10
+#define REPORT_BUFFER_CAP (1 << 20) //reporters flush every MiB
+#define ROW_BATCH 32 //rows of a parameterized slice a worker claims at once
+#define FUZZ_TIME_NS 1000000000 //time a fuzz target is fuzzed for, 1s
+#define FUZZ_MAX_LEN 4096 //longest input a fuzz target gets
+#define FUZZ_MINIMIZE_TRIES 4096 //inputs tried while minimizing a failing one
+#define NO_LIMIT UINT64_MAX //an allocation budget without a limit
+#define BASELINE_RUNS 10 //earlier runs a slice is compared against
+#define BASELINE_MIN_RUNS 5 //fewer earlier runs aren't worth comparing against
+#define REGRESSION_Z 3.5 //modified z-score above which a timing is an outlier
+#define REVISION_CAP 80 //longest revision the history keeps, with its '\0'
+
 
+typedef struct ToastFixture ToastFixture;
 
 //This struct is passed to each test case function, provided is only the 
 //[index] of the current test case. All other fields can be set within a 
@@ -38,27 +63,223 @@ typedef struct {
      it is just easier to set print_diagnostic to tell the suite that it needs
      to print the message. */
     int print_diagnostic;
+    /*Set by the runner, fixtures the test case can ask for with
+     `toast_fixture`, the file it is from and how long the fixtures it set up
+     took. */
+    ToastFixture *fixtures;
+    size_t num_fixtures;
+    const char *file;
+    uint64_t setup_ns;
 } BurntToast;
 
 //Type that represents a test case function;
 typedef void(*Toasting)(BurntToast*);
+//Type that represents a benchmark function, it has to run the measured code
+//[iters] times.
+typedef void(*Benching)(BurntToast*, uint64_t iters);
+
+//Type that represents a fixture setup or teardown function
+typedef void(*Preheating)(ToastFixture*);
+
+//A resource shared by the slices asking for it with `toast_fixture`. It is set
+//up on first use, the slices share it read-only and it is torn down once the
+//pack is done. Isolated workers can't share memory, each sets up its own.
+struct ToastFixture {
+    //Name slices ask for the fixture by
+    const char *name;
+    //Only slices from this file get the fixture, NULL shares it with the suite
+    const char *file;
+    //Has to set [value], leaving it NULL burns the slices asking for it
+    Preheating setup;
+    //Frees [value], may be NULL
+    Preheating teardown;
+    //What `toast_fixture` hands out
+    void *value;
+    //Setup can set this to say why it failed
+    const char *diagnostic;
+    //RAW until it is set up, then YUMMY or BURNT
+    int state;
+    pthread_mutex_t lock;
+    //How often it was set up and handed out, in all workers
+    size_t setups;
+    size_t uses;
+    //Time spent setting it up and tearing it down in ns
+    uint64_t setup_ns;
+    uint64_t teardown_ns;
+};
+
+//Type that represents a parameterized test case, it is run once per [row]
+typedef void(*Paraming)(BurntToast*, const void *row);
+
+//A line of a CSV file, [start] points into the mapped file and isn't
+//terminated
+typedef struct {
+    const char *start;
+    size_t len;
+} ToastLine;
+
+//Rows a parameterized slice runs over. Rows are used where they are, in an
+//array or a mapped file, and never copied.
+typedef struct {
+    //First row, set for arrays, mapped from [path] otherwise
+    const void *data;
+    //Bytes per row, 0 reads [path] as CSV and hands out a ToastLine per line
+    size_t stride;
+    //Number of rows, counted once [path] is mapped
+    size_t count;
+    //File the rows are mapped from when the pack runs, may be NULL
+    const char *path;
+    //Internal, the mapping of [path] and the lines of a CSV file
+    void *map;
+    size_t map_len;
+    ToastLine *lines;
+} ToastRows;
+
+//Rows of a C array
+#define TOAST_ROWS(array) ((ToastRows){.data = (array), .stride = sizeof((array)[0]), .count = sizeof(array)/sizeof((array)[0])})
+
+//Type that represents a fuzz target, it is called with one generated input
+//after the other
+typedef void(*Fuzzing)(BurntToast*, const uint8_t *data, size_t len);
+
+//What fuzzing a slice did
+typedef struct {
+    //Inputs the target ran on, and how many per second
+    uint64_t execs;
+    double execs_per_sec;
+    //Seed the generator started from, --fuzz-seed repeats the run
+    uint64_t seed;
+    //Inputs loaded from the corpus
+    size_t corpus;
+    //Length of the input that burnt the target, minimized and as found
+    size_t crash_len;
+    size_t found_len;
+    //Where that input was saved, NULL if it wasn't
+    char *crash_path;
+} FuzzStats;
+
+//Statistics of a benchmark, all times are nanoseconds per operation
+typedef struct {
+    //Iterations per sample the benchmark was calibrated to
+    uint64_t iters;
+    //Number of samples taken
+    size_t samples;
+    double mean;
+    double median;
+    double p99;
+    double stddev;
+    double ops_per_sec;
+} BenchStats;
 
 
+//Resources a test case used while it ran. Taken per thread where the platform
+//allows it, so they are accurate with parallel workers as well.
+typedef struct {
+    //CPU time spent in user space in ns
+    uint64_t user_ns;
+    //CPU time spent in the kernel in ns
+    uint64_t sys_ns;
+    //How much the peak resident set size grew, in KiB
+    long max_rss_kb;
+    //Page faults served without/with I/O
+    long minflt;
+    long majflt;
+    //Voluntary (blocking) and involuntary (preempted) context switches
+    long nvcsw;
+    long nivcsw;
+} ToastUsage;
+
+//Hardware counters a slice ran with, summed over [ops] operations. Only taken
+//with `counters` set, events the machine doesn't count stay 0.
+typedef struct {
+    //Operations the counts are spread over: 1 for a test, the iterations of a
+    //benchmark's samples and the inputs a fuzz target ran on. 0 if nothing
+    //was counted, e.g. the group never got onto the PMU.
+    uint64_t ops;
+    //Set if the PMU counted, without it only the software events are there
+    int hardware;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t branch_misses;
+    //Read misses of the L1 data and the last level cache
+    uint64_t l1d_misses;
+    uint64_t llc_misses;
+    uint64_t task_clock_ns;
+    uint64_t page_faults;
+    uint64_t context_switches;
+} ToastCounters;
+
+//Heap allocations of a slice, tracked if the suite is built with
+//TOAST_TRACK_ALLOCS. Only allocations of the thread running the slice count,
+//sizes are what the allocator handed out, a bit more than asked for at times.
+typedef struct {
+    //Set if the slice ran with tracking
+    int tracked;
+    //malloc, calloc, realloc and aligned allocations, and frees
+    uint64_t count;
+    uint64_t frees;
+    uint64_t bytes;
+    //Most bytes it held at once, and what it didn't free again
+    uint64_t peak_bytes;
+    uint64_t unfreed_bytes;
+    //Bytes held while it runs, below 0 if it freed memory from before it ran
+    int64_t live;
+    //Budget set with `toast_alloc_budget`, and what was spent of it
+    int budgeted;
+    uint64_t budget_count;
+    uint64_t budget_bytes;
+    uint64_t spent_count;
+    uint64_t spent_bytes;
+} ToastAllocs;
+
 //Struct that holds the test case function and it's metadata. Both on user 
 //side and internally
 typedef struct {
     //Test case function.
     Toasting toast;
+    //Benchmark function, set instead of [toast] for benchmarks
+    Benching bench;
     //Name of the test
     const char* name;
+    //Source file the test was found in, may be NULL
+    const char* file;
     //Restult identifier
     int result;
-    //Time it took to run
-    double time;
-    //Time unit. Can either be us, ms, or s.
-    int time_unit;
+    //Diagnostic the test case set when it failed, NULL otherwise
+    const char* diagnostic;
+    //Copy of a diagnostic an isolated worker reported, [diagnostic] points
+    //here then. Freed by unplug_toaster.
+    char *diagnostic_copy;
+    //Time it took to run in ns
+    uint64_t time_ns;
+    //Resources it took to run
+    ToastUsage usage;
+    //Statistics of a benchmark slice
+    BenchStats stats;
+    //Hash of everything the slice's result depends on, set by toaster, 0 if
+    //it is unknown. Slices whose key passed before are served from the memo.
+    uint64_t memo_key;
+    //Set if the result was served from the memo instead of running the slice
+    int cached;
+    //Parameterized test function, set instead of [toast]. The slice is
+    //expanded into one slice per row of [rows] when the pack runs.
+    Paraming param;
+    ToastRows *rows;
+    //Row an expanded slice runs and its index, NULL before expansion
+    const void *row_data;
+    size_t row;
+    //Fuzz target, set instead of [toast]
+    Fuzzing fuzz;
+    //What fuzzing the slice did
+    FuzzStats fuzz_stats;
+    //What the slice counted, ops is 0 if it wasn't counted
+    ToastCounters counters;
+    //What the slice allocated
+    ToastAllocs allocs;
 } SliceOfToast;
 
+typedef struct ToastReporter ToastReporter;
+
 //A Test Suite, with an array of tests (slices)
 typedef struct {
     //Collection of test cases
@@ -69,15 +290,119 @@ typedef struct {
     size_t cap;
     //Name of test-suite
     const char* brand;
-    //time all tests took
-    double time;
-    //Time unit. Can either be us, ms, or s.
-    int time_unit;
+    //How the suite was built, e.g. profile, compiler and flags, printed next
+    //to the brand. May be NULL.
+    const char* build;
+    //time all tests took in ns
+    uint64_t time_ns;
+    //Number of workers running the slices, 1 runs them on the calling thread
+    size_t jobs;
+    //Run the slices in forked worker processes, so a crashing test only burns
+    //its own slice
+    int isolate;
+    //Time in ns each benchmark is sampled for, split over [bench_samples]
+    uint64_t bench_time;
+    //Number of samples taken of each benchmark
+    size_t bench_samples;
+    //If set, only slices from these source files are run
+    char **only_files;
+    size_t num_only_files;
+    //If set, only slices whose name or file match one of these run. A filter
+    //is a glob, or a regex if it is enclosed in slashes, e.g. `/^add_/`
+    char **filters;
+    size_t num_filters;
+    //Runs only the slices of shard [shard_index] (1 based) out of
+    //[shard_count], 0 runs every slice
+    size_t shard_index;
+    size_t shard_count;
+    //Gets every result as soon as its slice is done, may be NULL
+    ToastReporter *reporter;
+    //A slice running longer than [timeout_ns] is killed and burnt, once
+    //[suite_timeout_ns] passed every running slice is, 0 means no limit.
+    //Setting either runs the slices isolated, threads can't be killed.
+    uint64_t timeout_ns;
+    uint64_t suite_timeout_ns;
+    //CPU seconds and bytes of address space a slice may use, isolated only,
+    //0 means no limit
+    uint64_t cpu_limit;
+    uint64_t as_limit;
+    //File with the memo keys of passed slices. If set, slices whose key is in
+    //there aren't run again and the file is updated after the run.
+    const char *memo_path;
+    //Hash of what each of [dep_files] included when it was compiled, set by
+    //toaster. It is mixed into the memo keys of the file's slices, so they run
+    //again once the code under test changes.
+    const char **dep_files;
+    uint64_t *dep_keys;
+    size_t num_dep_keys;
+    //Fixtures the slices can ask for
+    ToastFixture *fixtures;
+    size_t num_fixtures;
+    //Each fuzz target runs for [fuzz_time] ns or [fuzz_runs] inputs,
+    //whichever comes first, 0 means no limit
+    uint64_t fuzz_time;
+    uint64_t fuzz_runs;
+    //Seed of the input generator, 0 picks one from the clock
+    uint64_t fuzz_seed;
+    //Longest input a fuzz target gets
+    size_t fuzz_max_len;
+    //Directory with a directory of inputs per fuzz target, the inputs are
+    //replayed and mutated, and inputs that burn the target are saved there.
+    //May be NULL, failing inputs go to the working directory then.
+    const char *corpus_path;
+    //Count cycles, instructions, branch and cache misses of every slice with
+    //perf_event_open, or task-clock, page faults and context switches if the
+    //PMU can't be accessed
+    int counters;
+    //Burn slices that don't free what they allocated, needs TOAST_TRACK_ALLOCS
+    int leaks;
+    //File the timings of passed slices are appended to after every run,
+    //tagged with [revision]. May be NULL, nothing is kept then.
+    const char *history_path;
+    const char *revision;
+    //Compare every timing against the last [baseline_runs] runs in the
+    //history, only those of revision [baseline] if it is set. A slice that is
+    //an outlier of them and more than [min_slowdown] percent slower than their
+    //median regressed, and the run fails.
+    int compare;
+    uint64_t min_slowdown;
+    size_t baseline_runs;
+    const char *baseline;
 } PackOfToast;
 
+//Buffered writer the reporters write through, so a result doesn't cost a
+//syscall
+typedef struct {
+    int fd;
+    char *buf;
+    size_t len;
+    size_t cap;
+} ToastWriter;
+
+//Machine readable output. Set the callbacks to plug in a reporter of your own,
+//any of them may be NULL.
+struct ToastReporter {
+    //Called before the first slice runs
+    void (*begin)(ToastReporter *self, PackOfToast *pack);
+    //Called as soon as the slice at [index] is done, never concurrently
+    void (*report)(ToastReporter *self, size_t index, SliceOfToast *slice);
+    //Called once every slice is done
+    void (*end)(ToastReporter *self, PackOfToast *pack);
+    ToastWriter writer;
+};
+
 
 //Initializer function for a test case.
 SliceOfToast pre_bake_toast(const char* name, Toasting toast);
+//Initializer function for a benchmark.
+SliceOfToast pre_bake_bench(const char* name, Benching bench);
+//Initializer function for a fuzz target.
+SliceOfToast pre_bake_fuzz(const char* name, Fuzzing fuzz);
+//Initializer function for a test case run once per row of [rows]
+SliceOfToast pre_bake_params(const char* name, Paraming param, ToastRows *rows);
+//Rows of the file at [path], mapped when the pack runs. [stride] bytes each,
+//0 reads it as CSV lines.
+ToastRows map_rows(const char* path, size_t stride);
 
 //Initializer functoin for the test suite
 PackOfToast plug_in_toaster(const char* brand);
@@ -86,23 +411,146 @@ PackOfToast plug_in_toaster(const char* brand);
 void insert_toasts(PackOfToast *pack, SliceOfToast *slices, size_t len);
 //Insert singe test case into test suites
 void insert_toast(PackOfToast *pack, SliceOfToast slice);
+//Insert a fixture, slices get its value with `toast_fixture`
+void insert_fixture(PackOfToast *pack, ToastFixture fixture);
+//Insert the slices pointed to from [start] up to [stop]
+void insert_toast_section(PackOfToast *pack, SliceOfToast *const *start, SliceOfToast *const *stop);
+
+//Files compiled by toaster directly get a key for their slices' memo keys
+#ifndef TOAST_MEMO_KEY
+#define TOAST_MEMO_KEY 0
+#endif
+
+//The linker places a pointer to every slice defined with the TOAST macros
+//in the toast_slices section, between these two symbols. They are hidden, so
+//each executable or shared object sees its own slices.
+extern SliceOfToast *const __start_toast_slices[] __attribute__((weak, visibility("hidden")));
+extern SliceOfToast *const __stop_toast_slices[] __attribute__((weak, visibility("hidden")));
+
+//Defines a test case and registers it at link time, the body gets `burnt`:
+//  TOAST(adds_up) { eat_toast(burnt); }
+#define TOAST(fn) \
+    static void fn(BurntToast *burnt); \
+    static SliceOfToast toast_slice_##fn = {.toast = fn, .name = #fn, .file = __FILE__, .result = RAW, .memo_key = TOAST_MEMO_KEY}; \
+    static SliceOfToast *const toast_slot_##fn __attribute__((used, section("toast_slices"))) = &toast_slice_##fn; \
+    static void fn(BurntToast *burnt)
+
+//Defines a benchmark like TOAST, the body gets `burnt` and `iters`
+#define TOAST_BENCH(fn) \
+    static void fn(BurntToast *burnt, uint64_t iters); \
+    static SliceOfToast toast_slice_##fn = {.bench = fn, .name = #fn, .file = __FILE__, .result = RAW, .memo_key = TOAST_MEMO_KEY}; \
+    static SliceOfToast *const toast_slot_##fn __attribute__((used, section("toast_slices"))) = &toast_slice_##fn; \
+    static void fn(BurntToast *burnt, uint64_t iters)
 
-//Run the test suite
+//Defines a fuzz target like TOAST, the body gets `burnt`, `data` and `len`
+#define TOAST_FUZZ(fn) \
+    static void fn(BurntToast *burnt, const uint8_t *data, size_t len); \
+    static SliceOfToast toast_slice_##fn = {.fuzz = fn, .name = #fn, .file = __FILE__, .result = RAW, .memo_key = TOAST_MEMO_KEY}; \
+    static SliceOfToast *const toast_slot_##fn __attribute__((used, section("toast_slices"))) = &toast_slice_##fn; \
+    static void fn(BurntToast *burnt, const uint8_t *data, size_t len)
+
+//Defines a test case run once per element of [array] like TOAST, the body
+//gets `burnt` and `row`, a pointer to the element
+#define TOAST_PARAMS(fn, array) \
+    static void fn(BurntToast *burnt, const void *row); \
+    static ToastRows toast_rows_##fn = {.data = (array), .stride = sizeof((array)[0]), .count = sizeof(array)/sizeof((array)[0])}; \
+    static SliceOfToast toast_slice_##fn = {.param = fn, .rows = &toast_rows_##fn, .name = #fn, .file = __FILE__, .result = RAW, .memo_key = TOAST_MEMO_KEY}; \
+    static SliceOfToast *const toast_slot_##fn __attribute__((used, section("toast_slices"))) = &toast_slice_##fn; \
+    static void fn(BurntToast *burnt, const void *row)
+
+//Like TOAST_PARAMS, over the rows of the file at [path], [stride] bytes
+//each. A [stride] of 0 reads it as CSV, `row` is a ToastLine then.
+#define TOAST_PARAMS_FILE(fn, path_, stride_) \
+    static void fn(BurntToast *burnt, const void *row); \
+    static ToastRows toast_rows_##fn = {.path = (path_), .stride = (stride_)}; \
+    static SliceOfToast toast_slice_##fn = {.param = fn, .rows = &toast_rows_##fn, .name = #fn, .file = __FILE__, .result = RAW, .memo_key = TOAST_MEMO_KEY}; \
+    static SliceOfToast *const toast_slot_##fn __attribute__((used, section("toast_slices"))) = &toast_slice_##fn; \
+    static void fn(BurntToast *burnt, const void *row)
+
+//Insert every slice defined with the TOAST macros in the executable or
+//shared object this is called from
+#define insert_linked_toasts(pack) insert_toast_section((pack), __start_toast_slices, __stop_toast_slices)
+
+//Compiled with -DTOAST_MODULE=<symbol>, a test file exports its slices to
+//toast_host under that name
+#ifdef TOAST_MODULE
+void TOAST_MODULE(PackOfToast *pack) {
+    insert_linked_toasts(pack);
+}
+#endif
+
+//Apply runner options (e.g. `-j <jobs>`) passed on the command line
+void turn_dials(PackOfToast *pack, int argc, char **argv);
+
+//Run the test suite. Returns non-zero if a slice regressed against the
+//history, see [compare].
 int toast(PackOfToast pack);
+//Run the test suite on [jobs] worker threads, AUTO_JOBS uses every core
+int toast_parallel(PackOfToast pack, size_t jobs);
+//Run the test suite on [jobs] pre-forked worker processes, AUTO_JOBS uses
+//every core. A worker that dies only burns the slice it was running.
+int toast_isolated(PackOfToast pack, size_t jobs);
+//Run only the slices at [indices], results are written back to the pack
+int toast_run_subset(PackOfToast pack, const size_t *indices, size_t len);
 //Clean/free memory
 void unplug_toaster(PackOfToast pack);
 
+//Opens a reporter of [kind] ("jsonl" or "junit") writing to [path], "-" is
+//stdout. Returns NULL if the kind is unknown or the path can't be opened.
+ToastReporter *open_reporter(const char *kind, const char *path);
+//Flushes and frees a reporter
+void close_reporter(ToastReporter *reporter);
+
+//Keeps test modules (shared objects exporting a `void name(PackOfToast*)`
+//registering their slices) loaded and runs them on request. Commands are read
+//line by line from [cmd_fd]:
+//  module <path> <symbol>  load <path> unless it is loaded, and run it next
+//  arg <arg>               runner option for the next run, see turn_dials
+//  run                     run the listed modules in a forked child, and
+//                          unload modules that weren't listed
+//"done <wait status>" is written to [status_fd] after every run. Returns
+//once [cmd_fd] is closed.
+int toast_host(int cmd_fd, int status_fd);
+
 //Helper function to populate a the test case functoin argument with a negative 
 //result
 void burn_toast(BurntToast *burnt, char* diagnostic);
 //Helper function to populate a the test case functoin argument with a positive 
 //result
 void eat_toast(BurntToast *burnt);
+//Returns the value of fixture [name], setting it up if nobody asked for it
+//yet. A fixture of the test's own file wins over one of the suite. Burns the
+//toast and returns NULL if there is no such fixture or its setup failed.
+void *toast_fixture(BurntToast *burnt, const char *name);
+//Burns the toast once it ran if it allocates more than [allocs] times or
+//[bytes] bytes from here on, NO_LIMIT leaves either open. Only checked if the
+//suite is built with TOAST_TRACK_ALLOCS.
+void toast_alloc_budget(BurntToast *burnt, uint64_t allocs, uint64_t bytes);
 
 #endif //TOAST_H_
        
 #ifdef TOAST_IMPLEMENTATION
 
+#include <time.h>
+#include <signal.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <fnmatch.h>
+#include <regex.h>
+#include <dlfcn.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <malloc.h>
+#endif
+
 #define ESC "\x1B["
 #define RES "\x1B[0m"
 #define BOLD "1"
@@ -113,35 +561,305 @@ void eat_toast(BurntToast *burnt);
 #define LIGHT_RED = "9"
 #define CLR "\x1B[38;5"
 
-struct timeval get_time_stamp() {
-    struct timeval tv;
-    gettimeofday(&tv,NULL);
-    return tv;
+static uint64_t get_time_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
 }
 
-/*
- * Returns 0 if result should be represented as micorseconds (us), 
- * 1 if represented as milliseconds (ms)
- * 2 if represend as seconds
- * */
-double delta_time(struct timeval start, struct timeval end, int *unit) {
-    long delta, seconds, useconds;    
-    seconds  = end.tv_sec  - start.tv_sec;
-    useconds = end.tv_usec - start.tv_usec;
-    delta = (seconds*1000*1000) + useconds; //in microseconds
-    if (delta > 1000 && delta < 1000000) {
-        *unit = 1;
-        return (double)delta / 1000.0;
-    } else if (delta >= 1000000) {
-        *unit = 2;
-        return (double)delta / (1000.0*1000.0);
-    }
-    *unit = 0;
-    return (double)delta;
-}
-
-
-void report_error(char* msg) {
+//Formats a duration in ns with a unit that keeps it readable
+static const char *format_ns(uint64_t ns, char *buf, size_t cap) {
+    if (ns < 1000) {
+        snprintf(buf, cap, "%luns", (unsigned long)ns);
+    } else if (ns < 1000000) {
+        snprintf(buf, cap, "%.3fus", ns/1e3);
+    } else if (ns < 1000000000) {
+        snprintf(buf, cap, "%.3fms", ns/1e6);
+    } else {
+        snprintf(buf, cap, "%.3fs", ns/1e9);
+    }
+    return buf;
+}
+
+#ifdef RUSAGE_THREAD
+#define USAGE_WHO RUSAGE_THREAD
+#else
+#define USAGE_WHO RUSAGE_SELF
+#endif
+
+static void get_usage(struct rusage *ru) {
+    if (getrusage(USAGE_WHO, ru) < 0) {
+        memset(ru, 0, sizeof(*ru));
+    }
+}
+
+static uint64_t timeval_ns(struct timeval tv) {
+    return (uint64_t)tv.tv_sec*1000000000 + (uint64_t)tv.tv_usec*1000;
+}
+
+static ToastUsage delta_usage(struct rusage *start, struct rusage *end) {
+    return (ToastUsage){
+        .user_ns = timeval_ns(end->ru_utime) - timeval_ns(start->ru_utime),
+        .sys_ns = timeval_ns(end->ru_stime) - timeval_ns(start->ru_stime),
+        .max_rss_kb = end->ru_maxrss - start->ru_maxrss,
+        .minflt = end->ru_minflt - start->ru_minflt,
+        .majflt = end->ru_majflt - start->ru_majflt,
+        .nvcsw = end->ru_nvcsw - start->ru_nvcsw,
+        .nivcsw = end->ru_nivcsw - start->ru_nivcsw,
+    };
+}
+
+static void add_usage(ToastUsage *total, ToastUsage *usage) {
+    total->user_ns += usage->user_ns;
+    total->sys_ns += usage->sys_ns;
+    total->max_rss_kb += usage->max_rss_kb;
+    total->minflt += usage->minflt;
+    total->majflt += usage->majflt;
+    total->nvcsw += usage->nvcsw;
+    total->nivcsw += usage->nivcsw;
+}
+
+#ifdef __linux__
+//Events of a counter group, the first one that opens leads it. Hardware
+//events are counted in user space only, which needs no privileges.
+typedef struct {
+    uint32_t type;
+    uint64_t config;
+    size_t offset;
+} CounterEvent;
+
+static const CounterEvent counter_events[] = {
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, offsetof(ToastCounters, cycles)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, offsetof(ToastCounters, instructions)},
+    {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, offsetof(ToastCounters, branch_misses)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 
+        offsetof(ToastCounters, l1d_misses)},
+    {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), 
+        offsetof(ToastCounters, llc_misses)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, offsetof(ToastCounters, task_clock_ns)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS, offsetof(ToastCounters, page_faults)},
+    {PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, offsetof(ToastCounters, context_switches)},
+};
+#define NUM_COUNTERS (sizeof(counter_events)/sizeof(counter_events[0]))
+
+//The counters of a thread, they only count the thread that opened them
+typedef struct {
+    //-1 until the group is open
+    int leader;
+    int fds[NUM_COUNTERS];
+    //field of ToastCounters each value of a group read goes to
+    size_t offsets[NUM_COUNTERS];
+    size_t num;
+    int hardware;
+} CounterGroup;
+
+static __thread CounterGroup counter_group = {.leader = -1};
+
+static int open_counter(const CounterEvent *event, int leader, int exclude_kernel) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = event->type;
+    attr.config = event->config;
+    attr.disabled = leader < 0;
+    attr.exclude_kernel = exclude_kernel;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC);
+}
+
+//Opens the counter group of the calling thread unless it is open. Events
+//the machine or the container doesn't allow are left out, without a PMU
+//only the software events are left. Returns 0 if anything is counted.
+static int open_counters(void) {
+    CounterGroup *group = &counter_group;
+    if (group->leader >= 0) {
+        return 0;
+    }
+    group->num = 0;
+    for (size_t e = 0; e < NUM_COUNTERS; ++e) {
+        const CounterEvent *event = &counter_events[e];
+        int hardware = event->type != PERF_TYPE_SOFTWARE;
+        //context switches happen in the kernel, they are only counted with it
+        int fd = open_counter(event, group->leader, hardware);
+        if (fd < 0 && !hardware) {
+            fd = open_counter(event, group->leader, 1);
+        }
+        if (fd < 0) {
+            continue;
+        }
+        if (group->leader < 0) {
+            group->leader = fd;
+            group->hardware = hardware;
+        }
+        group->fds[group->num] = fd;
+        group->offsets[group->num++] = event->offset;
+    }
+    return group->leader >= 0 ? 0 : -1;
+}
+
+static void close_counters(void) {
+    CounterGroup *group = &counter_group;
+    for (size_t k = 0; k < group->num; ++k) {
+        close(group->fds[k]);
+    }
+    *group = (CounterGroup){.leader = -1};
+}
+
+//Resets and starts the counters of the calling thread, returns 0 if they
+//are counting
+static int start_counters(void) {
+    if (open_counters() < 0) {
+        return -1;
+    }
+    ioctl(counter_group.leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+    ioctl(counter_group.leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return 0;
+}
+
+//Stops the counters and adds what they counted to [counters]. Counts of a
+//group that had to share the PMU are scaled up to the time it was enabled.
+//Returns -1 if the group never got onto the PMU, nothing was counted then.
+static int stop_counters(ToastCounters *counters) {
+    CounterGroup *group = &counter_group;
+    ioctl(group->leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    uint64_t values[3 + NUM_COUNTERS];
+    ssize_t got = read(group->leader, values, sizeof(values));
+    if (got < (ssize_t)(3*sizeof(uint64_t)) || values[2] == 0) {
+        return -1;
+    }
+    uint64_t enabled = values[1], running = values[2];
+    for (size_t k = 0; k < values[0] && k < group->num; ++k) {
+        uint64_t value = values[3 + k];
+        if (running < enabled) {
+            value = (uint64_t)((double)value*enabled/running);
+        }
+        *(uint64_t*)((char*)counters + group->offsets[k]) += value;
+    }
+    counters->hardware = group->hardware;
+    return 0;
+}
+#else
+typedef struct {
+    int leader;
+    int hardware;
+} CounterGroup;
+
+static __thread CounterGroup counter_group = {.leader = -1};
+
+static int open_counters(void) {
+    errno = ENOSYS;
+    return -1;
+}
+static void close_counters(void) {}
+static int start_counters(void) {
+    return -1;
+}
+static int stop_counters(ToastCounters *counters) {
+    (void)counters;
+    return -1;
+}
+#endif
+
+//Where the allocations of the calling thread are tracked, NULL while it
+//doesn't run a slice
+static __thread ToastAllocs *alloc_slice = NULL;
+
+//glibc's allocator stays reachable under these names, so the functions below
+//can replace malloc & co. in the test suite. Sanitizers replace them
+//themselves, tracking is left out then.
+#if defined(TOAST_TRACK_ALLOCS) && defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define ALLOCS_TRACKED 1
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t align, size_t size);
+extern void __libc_free(void *ptr);
+
+static void note_alloc(void *ptr) {
+    ToastAllocs *allocs = alloc_slice;
+    if (allocs == NULL || ptr == NULL) {
+        return;
+    }
+    size_t size = malloc_usable_size(ptr);
+    allocs->count++;
+    allocs->bytes += size;
+    allocs->live += size;
+    if (allocs->live > (int64_t)allocs->peak_bytes) {
+        allocs->peak_bytes = allocs->live;
+    }
+}
+
+static void note_free(void *ptr) {
+    ToastAllocs *allocs = alloc_slice;
+    if (allocs == NULL || ptr == NULL) {
+        return;
+    }
+    allocs->frees++;
+    allocs->live -= malloc_usable_size(ptr);
+}
+
+void *malloc(size_t size) {
+    void *ptr = __libc_malloc(size);
+    note_alloc(ptr);
+    return ptr;
+}
+
+void *calloc(size_t n, size_t size) {
+    void *ptr = __libc_calloc(n, size);
+    note_alloc(ptr);
+    return ptr;
+}
+
+//Counts as a free of the old block and an allocation of the new one
+void *realloc(void *ptr, size_t size) {
+    if (alloc_slice == NULL) {
+        return __libc_realloc(ptr, size);
+    }
+    size_t old = ptr != NULL ? malloc_usable_size(ptr) : 0;
+    void *moved = __libc_realloc(ptr, size);
+    if (moved == NULL && size > 0) {
+        return NULL;
+    }
+    if (ptr != NULL) {
+        alloc_slice->frees++;
+        alloc_slice->live -= old;
+    }
+    note_alloc(moved);
+    return moved;
+}
+
+void free(void *ptr) {
+    note_free(ptr);
+    __libc_free(ptr);
+}
+
+void *memalign(size_t align, size_t size) {
+    void *ptr = __libc_memalign(align, size);
+    note_alloc(ptr);
+    return ptr;
+}
+
+void *aligned_alloc(size_t align, size_t size) {
+    return memalign(align, size);
+}
+
+int posix_memalign(void **out, size_t align, size_t size) {
+    if (align < sizeof(void*) || (align & (align - 1)) != 0) {
+        return EINVAL;
+    }
+    void *ptr = memalign(align, size);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *out = ptr;
+    return 0;
+}
+#else
+#define ALLOCS_TRACKED 0
+#endif
+
+static void report_error(char* msg) {
     fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] %s\n", msg);
 }
 
@@ -150,15 +868,68 @@ SliceOfToast pre_bake_toast(const char* name, Toasting toast) {
         .toast = toast,
         .name = name,
         .result = -1,
+        .diagnostic = NULL,
+    };
+}
+
+SliceOfToast pre_bake_bench(const char* name, Benching bench) {
+    return (SliceOfToast){
+        .bench = bench,
+        .name = name,
+        .result = -1,
+        .diagnostic = NULL,
     };
 }
 
+SliceOfToast pre_bake_fuzz(const char* name, Fuzzing fuzz) {
+    return (SliceOfToast){
+        .fuzz = fuzz,
+        .name = name,
+        .result = -1,
+        .diagnostic = NULL,
+    };
+}
+
+SliceOfToast pre_bake_params(const char* name, Paraming param, ToastRows *rows) {
+    return (SliceOfToast){
+        .param = param,
+        .rows = rows,
+        .name = name,
+        .result = -1,
+        .diagnostic = NULL,
+    };
+}
+
+ToastRows map_rows(const char* path, size_t stride) {
+    return (ToastRows){.path = path, .stride = stride};
+}
+
+//Name of a slice, with the row of an expanded parameterized slice
+static const char *slice_label(SliceOfToast *slice, char *buf, size_t cap) {
+    if (slice->row_data == NULL) {
+        return slice->name;
+    }
+    snprintf(buf, cap, "%s[%ld]", slice->name, slice->row);
+    return buf;
+}
+
+//Benchmarks and fuzz targets run one at a time once the tests are done
+static int runs_alone(SliceOfToast *slice) {
+    return slice->bench != NULL || slice->fuzz != NULL;
+}
+
 PackOfToast plug_in_toaster(const char* brand) {
     return (PackOfToast){
         .slices = malloc(sizeof(SliceOfToast)*INITIAL_SLOTS),
         .size = 0,
         .cap = INITIAL_SLOTS,
-        .brand =  brand
+        .brand =  brand,
+        .jobs = 1,
+        .bench_time = BENCH_TIME_NS,
+        .bench_samples = BENCH_SAMPLES,
+        .fuzz_time = FUZZ_TIME_NS,
+        .fuzz_max_len = FUZZ_MAX_LEN,
+        .baseline_runs = BASELINE_RUNS
     };
 }
 
@@ -196,18 +967,182 @@ void insert_toast(PackOfToast *pack, SliceOfToast slice) {
     return;
 }
 
-void print_stats(PackOfToast *pack) {
-    char name[14];
+void insert_fixture(PackOfToast *pack, ToastFixture fixture) {
+    pack->fixtures = realloc(pack->fixtures, sizeof(ToastFixture)*(pack->num_fixtures + 1));
+    if (pack->fixtures == NULL) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    fixture.value = NULL;
+    fixture.state = RAW;
+    pack->fixtures[pack->num_fixtures++] = fixture;
+}
+
+void insert_toast_section(PackOfToast *pack, SliceOfToast *const *start, SliceOfToast *const *stop) {
+    for (SliceOfToast *const *slot = start; slot != NULL && slot < stop; ++slot) {
+        SliceOfToast slice = **slot;
+        //TOAST_MEMO_KEY covers the file, the name tells its slices apart
+        for (const char *c = slice.name; slice.memo_key != 0 && *c != '\0'; ++c) {
+            slice.memo_key = (slice.memo_key ^ (unsigned char)*c)*0x100000001b3;
+        }
+        insert_toast(pack, slice);
+    }
+}
+
+static void print_fixture_stats(PackOfToast *pack) {
+    printf("\n  ++ "ESC"1mFixtures"RES"\n\n");     
+    printf("           | Fixture       | Scope         | Outcome | Setups  | Uses    | Setup      | Teardown   |\n");
+    printf("           | ============= | ============= | ======= | ======= | ======= | ========== | ========== |\n");
+    for (size_t f = 0; f < pack->num_fixtures; ++f) {
+        ToastFixture *fixture = &pack->fixtures[f];
+        char setup[16], teardown[16];
+        printf("           | %-14.13s| %-14.13s| %-8s| %-8ld| %-8ld| %-11s| %-11s|\n", 
+                fixture->name, fixture->file != NULL ? fixture->file : "suite",
+                fixture->setups == 0 ? "unused" : fixture->state == BURNT ? "fail" : "ready",
+                fixture->setups, fixture->uses, 
+                format_ns(fixture->setup_ns, setup, sizeof(setup)),
+                format_ns(fixture->teardown_ns, teardown, sizeof(teardown)));
+        printf("           | ------------- | ------------- | ------- | ------- | ------- | ---------- | ---------- |\n");
+    }
+    printf("\n");
+}
+
+static void print_bench_stats(PackOfToast *pack) {
+    printf("\n  ++ "ESC"1mBenchmarks"RES"\n\n");     
+    printf("           | Test Id | Bench Name    | Outcome | ns/op      | Median     | p99        | Stddev     | ops/s        | Iters x Samples  |\n");
+    printf("           | ======= | ============= | ======= | ========== | ========== | ========== | ========== | ============ | ================ |\n");
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (slice->bench == NULL) {
+            continue;
+        }
+        BenchStats *st = &slice->stats;
+        char runs[32];
+        snprintf(runs, sizeof(runs), "%lu x %ld", (unsigned long)st->iters, st->samples);
+        printf("           | %-8ld| %-14.13s| %-8s| %-11.2f| %-11.2f| %-11.2f| %-11.2f| %-13.0f| %-17s|\n", 
+                i+1, slice->name, slice->result == 0 ? "pass" : "fail", 
+                st->mean, st->median, st->p99, st->stddev, st->ops_per_sec, runs);
+        printf("           | ------- | ------------- | ------- | ---------- | ---------- | ---------- | ---------- | ------------ | ---------------- |\n");
+    }
+    printf("\n");
+}
+
+static void print_fuzz_stats(PackOfToast *pack) {
+    printf("\n  ++ "ESC"1mFuzz Targets"RES"\n\n");     
+    printf("           | Test Id | Fuzz Target   | Outcome | Execs        | Execs/s      | Corpus  | Input    | Seed                 |\n");
+    printf("           | ======= | ============= | ======= | ============ | ============ | ======= | ======== | ==================== |\n");
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (slice->fuzz == NULL) {
+            continue;
+        }
+        FuzzStats *st = &slice->fuzz_stats;
+        char input[16] = "-";
+        if (slice->result == BURNT && st->execs > 0) {
+            snprintf(input, sizeof(input), "%ld B", st->crash_len);
+        }
+        printf("           | %-8ld| %-14.13s| %-8s| %-13lu| %-13.0f| %-8ld| %-9s| %-21lu|\n", 
+                i+1, slice->name, slice->result == RAW ? "not run" : slice->result == 0 ? "pass" : "fail", 
+                (unsigned long)st->execs, st->execs_per_sec, st->corpus, input, (unsigned long)st->seed);
+        printf("           | ------- | ------------- | ------- | ------------ | ------------ | ------- | -------- | -------------------- |\n");
+    }
+    printf("\n");
+}
+
+//Per op, so benchmarks and fuzz targets compare with tests, "-" if it wasn't
+//counted
+static const char *per_op(uint64_t count, ToastCounters *c, int hardware, char *buf, size_t cap) {
+    if (c->ops == 0 || (hardware && !c->hardware)) {
+        return "-";
+    }
+    snprintf(buf, cap, "%.2f", (double)count/c->ops);
+    return buf;
+}
+
+static void print_counter_stats(PackOfToast *pack) {
+    printf("\n  ++ "ESC"1mCounters"RES"\n\n");     
+    printf("           | Test Id | Test Name     | Ops          | Cycles/op  | IPC    | BrMiss/op  | L1dMiss/op | LLCMiss/op | PgFlt/op   | CSw/op     |\n");
+    printf("           | ======= | ============= | ============ | ========== | ====== | ========== | ========== | ========== | ========== | ========== |\n");
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        ToastCounters *c = &slice->counters;
+        if (c->ops == 0) {
+            continue;
+        }
+        char label[256], ipc[16] = "-", cycles[32], br[32], l1d[32], llc[32], pf[32], cs[32];
+        if (c->hardware && c->cycles > 0) {
+            snprintf(ipc, sizeof(ipc), "%.2f", (double)c->instructions/c->cycles);
+        }
+        printf("           | %-8ld| %-14.13s| %-13lu| %-11s| %-7s| %-11s| %-11s| %-11s| %-11s| %-11s|\n", 
+                i+1, slice_label(slice, label, sizeof(label)), (unsigned long)c->ops,
+                per_op(c->cycles, c, 1, cycles, sizeof(cycles)), ipc,
+                per_op(c->branch_misses, c, 1, br, sizeof(br)),
+                per_op(c->l1d_misses, c, 1, l1d, sizeof(l1d)),
+                per_op(c->llc_misses, c, 1, llc, sizeof(llc)),
+                per_op(c->page_faults, c, 0, pf, sizeof(pf)),
+                per_op(c->context_switches, c, 0, cs, sizeof(cs)));
+        printf("           | ------- | ------------- | ------------ | ---------- | ------ | ---------- | ---------- | ---------- | ---------- | ---------- |\n");
+    }
+    printf("\n");
+}
+
+//A budget as "spent/budget", NO_LIMIT as "any"
+static const char *format_budget(uint64_t spent, uint64_t budget, char *buf, size_t cap) {
+    if (budget == NO_LIMIT) {
+        snprintf(buf, cap, "%lu/any", (unsigned long)spent);
+    } else {
+        snprintf(buf, cap, "%lu/%lu", (unsigned long)spent, (unsigned long)budget);
+    }
+    return buf;
+}
+
+static void print_alloc_stats(PackOfToast *pack) {
+    printf("\n  ++ "ESC"1mAllocations"RES"\n\n");     
+    printf("           | Test Id | Test Name     | Allocs     | Frees      | Bytes        | Peak         | Unfreed      | Budget Allocs   | Budget Bytes        |\n");
+    printf("           | ======= | ============= | ========== | ========== | ============ | ============ | ============ | =============== | =================== |\n");
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        ToastAllocs *a = &slice->allocs;
+        if (!a->tracked) {
+            continue;
+        }
+        char label[256], count[48] = "-", bytes[48] = "-";
+        if (a->budgeted) {
+            format_budget(a->spent_count, a->budget_count, count, sizeof(count));
+            format_budget(a->spent_bytes, a->budget_bytes, bytes, sizeof(bytes));
+        }
+        printf("           | %-8ld| %-14.13s| %-11lu| %-11lu| %-13lu| %-13lu| %-13lu| %-16s| %-20s|\n", 
+                i+1, slice_label(slice, label, sizeof(label)), (unsigned long)a->count, (unsigned long)a->frees,
+                (unsigned long)a->bytes, (unsigned long)a->peak_bytes, (unsigned long)a->unfreed_bytes, count, bytes);
+        printf("           | ------- | ------------- | ---------- | ---------- | ------------ | ------------ | ------------ | --------------- | ------------------- |\n");
+    }
+    printf("\n");
+}
+
+static void print_usage_row(const char *id, const char *name, const char *outcome, uint64_t time_ns, ToastUsage *u) {
+    char t[16], user[16], sys[16];
+    printf("           | %-8s| %-14.13s| %-8s| %-11s| %-11s| %-11s| %-9ld| %-8ld| %-8ld| %-8ld| %-8ld|\n",
+            id, name, outcome, format_ns(time_ns, t, sizeof(t)),
+            format_ns(u->user_ns, user, sizeof(user)), format_ns(u->sys_ns, sys, sizeof(sys)),
+            u->max_rss_kb, u->minflt, u->majflt, u->nvcsw, u->nivcsw);
+}
+
+static void print_stats(PackOfToast *pack) {
     int success = 0;
     int failed = 0;
     int not_run = 0;
-    double tests_total = 0.0;
+    uint64_t tests_total = 0;
+    ToastUsage usage_total = {0};
 
     printf("\n  ++ "ESC"1mOverview"RES"\n\n");     
-    printf("           | Test Id | Test Name     | Outcome | Time       | T Unit |\n");
-    printf("           | ======= | ============= | ======= | ========== | ====== |\n");
+    printf("           | Test Id | Test Name     | Outcome | Time       | User       | Sys        | +RSS KiB | MinFlt  | MajFlt  | VCsw    | ICsw    |\n");
+    printf("           | ======= | ============= | ======= | ========== | ========== | ========== | ======== | ======= | ======= | ======= | ======= |\n");
     
 
+    size_t alone = 0;
+    size_t fuzzers = 0;
+    uint64_t fuzz_execs = 0;
+    uint64_t fuzz_ns = 0;
     for (size_t i = 0; i < pack->size; ++i) {
         SliceOfToast slice = pack->slices[i];
         if (slice.result == 1) {
@@ -217,40 +1152,81 @@ void print_stats(PackOfToast *pack) {
         } else {
             not_run += 1;
         }
-        size_t j = 0;
-        while (j < 14) {
-            name[j] = slice.name[j];
-            if (name[j] == '\0') {
-                break;
-            }
-            j++;
+        if (slice.fuzz != NULL) {
+            fuzzers++;
+            fuzz_execs += slice.fuzz_stats.execs;
+            fuzz_ns += slice.time_ns;
         }
-        char unit[3] = "us";
-        double added_time = slice.time / 1000;
-        if (slice.time_unit == 1) {
-            unit[0] = 'm';
-            added_time = slice.time;
-        } else if (slice.time_unit == 2) {
-            unit[0] = 's'; unit[1] = ' ';
-            added_time = slice.time*1000;
+        if (runs_alone(&slice)) {
+            alone++;
+            continue;
         }
-        tests_total += added_time;
+        tests_total += slice.time_ns;
+        add_usage(&usage_total, &slice.usage);
 
-        printf("           | %-8ld| %-14s| %-8s| %-11.4f| %-7s|\n", i+1, name, slice.result == 0 ? "pass" : "fail", slice.time, unit);
-        printf("           | ------- | ------------- | ------- | ---------- | ------ |\n");
+        char id[16], label[256];
+        snprintf(id, sizeof(id), "%ld", i+1);
+        print_usage_row(id, slice_label(&slice, label, sizeof(label)), slice.result == RAW ? "not run" : slice.cached ? "cached" : slice.result == 0 ? "pass" : "fail", slice.time_ns, &slice.usage);
+        printf("           | ------- | ------------- | ------- | ---------- | ---------- | ---------- | -------- | ------- | ------- | ------- | ------- |\n");
 
     }
+    print_usage_row("Total", "", "", tests_total, &usage_total);
+    printf("\n");
 
-    
-    char unit[3] = "us";
-    if (pack->time_unit == 1) {
-        unit[0] = 'm';
-    } else if (pack->time_unit == 2) {
-        unit[0] = 's';
-        unit[1] = ' ';
-    }
-    printf("     Total Time:       %.4f%s\n", pack->time, unit);
-    printf("     Avg. Time/Test:   %.4fms\n", tests_total/pack->size);
+    if (alone > fuzzers) {
+        print_bench_stats(pack);
+    }
+    if (fuzzers > 0) {
+        print_fuzz_stats(pack);
+    }
+    //IPC of the tests, benchmarks and fuzz targets would drown them out
+    uint64_t cycles = 0, instructions = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        if (!runs_alone(&pack->slices[i])) {
+            cycles += pack->slices[i].counters.cycles;
+            instructions += pack->slices[i].counters.instructions;
+        }
+    }
+    if (pack->counters) {
+        print_counter_stats(pack);
+    }
+    uint64_t allocs = 0, alloc_bytes = 0, unfreed = 0;
+    int tracked = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        ToastAllocs *a = &pack->slices[i].allocs;
+        tracked |= a->tracked;
+        allocs += a->count;
+        alloc_bytes += a->bytes;
+        unfreed += a->unfreed_bytes;
+    }
+    if (tracked) {
+        print_alloc_stats(pack);
+    }
+    uint64_t setup_total = 0;
+    for (size_t f = 0; f < pack->num_fixtures; ++f) {
+        setup_total += pack->fixtures[f].setup_ns;
+    }
+    if (pack->num_fixtures > 0) {
+        print_fixture_stats(pack);
+    }
+
+    char t[16];
+    printf("     Total Time:       %s\n", format_ns(pack->time_ns, t, sizeof(t)));
+    if (setup_total > 0) {
+        printf("     Fixture Setup:    %s\n", format_ns(setup_total, t, sizeof(t)));
+    }
+    if (pack->size > alone) {
+        printf("     Avg. Time/Test:   %s\n", format_ns(tests_total/(pack->size - alone), t, sizeof(t)));
+    }
+    if (cycles > 0) {
+        printf("     IPC:              %.2f (%lu cycles)\n", (double)instructions/cycles, (unsigned long)cycles);
+    }
+    if (tracked) {
+        printf("     Allocations:      %lu (%lu bytes, %lu unfreed)\n", (unsigned long)allocs, (unsigned long)alloc_bytes, (unsigned long)unfreed);
+    }
+    if (fuzz_execs > 0) {
+        printf("     Fuzz Execs/s:     %.0f (%lu execs)\n", fuzz_ns > 0 ? fuzz_execs*1e9/fuzz_ns : 0.0, (unsigned long)fuzz_execs);
+    }
     printf("     "CLR";"SUCCESS"mSuccess:          %d"RES"\n", success);
 
     printf("     "CLR";"ERROR"mFailed:           %d"RES"\n", failed);
@@ -261,65 +1237,2585 @@ void print_stats(PackOfToast *pack) {
     return;
 };
 
-void reset_burnt(BurntToast *burnt, int index) {
+static void reset_burnt(BurntToast *burnt, int index) {
    burnt->index = index;
    burnt->yummy_or_burnt = RAW;
    burnt->diagnostic = " ";
    burnt->print_diagnostic = 0;
+   burnt->setup_ns = 0;
 }
 
-int toast(PackOfToast pack) {
-    struct timeval suite_start = get_time_stamp();
-
-    printf("\n\n +++ "ESC"1mTOASTER BRAND: %s"RES" +++\n", pack.brand);     
-    printf("     Inserted %ld toasts\n\n", pack.size);
-
-    BurntToast *burnt = malloc(sizeof(BurntToast));
-    burnt->diagnostic = malloc(ERROR_BUFFER_CAP);
-    reset_burnt(burnt, -1);
-
-    for (size_t i = 0; i < pack.size; ++i) {
-        burnt->index = i;
-        struct timeval test_start = get_time_stamp();
-        SliceOfToast *slice = &pack.slices[i];
-        printf("  %ld) %s\n", i+1, slice->name);
+//Reads the non-negative number following the option at argv[*i]
+static unsigned long dial_number(int argc, char **argv, int *i) {
+    char *end = NULL;
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] expected a number after '%s'\n", argv[*i]);
+        exit(1);
+    }
+    *i += 1;
+    unsigned long value = strtoul(argv[*i], &end, 10);
+    if (argv[*i][0] == '-' || *end != '\0') {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] '%s' has to be a non-negative integer\n", argv[*i-1]);
+        exit(1);
+    }
+    return value;
+}
 
-        //run test function
-        slice->toast(burnt);
-        slice->result = burnt->yummy_or_burnt;
-        if (slice->result > 0) {
-            printf("    "CLR";"ERROR"m >> fail"RES"\n");
-            if (burnt->print_diagnostic) {
-                printf("        Diagnostic: %s\n\n", burnt->diagnostic);
+void turn_dials(PackOfToast *pack, int argc, char **argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0) {
+            pack->jobs = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--bench-time") == 0) {
+            pack->bench_time = dial_number(argc, argv, &i)*1000000;
+        } else if (strcmp(argv[i], "--bench-samples") == 0) {
+            pack->bench_samples = dial_number(argc, argv, &i);
+            if (pack->bench_samples == 0) {
+                report_error("a benchmark needs at least one sample");
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--fuzz-time") == 0) {
+            pack->fuzz_time = dial_number(argc, argv, &i)*1000000;
+        } else if (strcmp(argv[i], "--fuzz-runs") == 0) {
+            pack->fuzz_runs = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--fuzz-seed") == 0) {
+            pack->fuzz_seed = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--fuzz-max-len") == 0) {
+            pack->fuzz_max_len = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--corpus") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a directory after '--corpus'");
+                exit(1);
+            }
+            pack->corpus_path = argv[++i];
+        } else if (strcmp(argv[i], "--file") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a source file after '--file'");
+                exit(1);
+            }
+            pack->only_files = realloc(pack->only_files, sizeof(char*)*(pack->num_only_files + 1));
+            pack->only_files[pack->num_only_files++] = argv[++i];
+        } else if (strcmp(argv[i], "-f") == 0 || strcmp(argv[i], "--filter") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a glob or /regex/ after '--filter'");
+                exit(1);
+            }
+            pack->filters = realloc(pack->filters, sizeof(char*)*(pack->num_filters + 1));
+            pack->filters[pack->num_filters++] = argv[++i];
+        } else if (strcmp(argv[i], "-r") == 0 || strcmp(argv[i], "--reporter") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected <jsonl|junit>[:<path>] after '--reporter'");
+                exit(1);
+            }
+            i += 1;
+            char kind[16] = {0};
+            const char *path = strchr(argv[i], ':');
+            size_t kind_len = path != NULL ? (size_t)(path - argv[i]) : strlen(argv[i]);
+            memcpy(kind, argv[i], kind_len < sizeof(kind) ? kind_len : sizeof(kind) - 1);
+            if (path == NULL) {
+                path = strcmp(kind, "junit") == 0 ? "toast_report.xml" : "toast_report.jsonl";
             } else {
-                printf("\n");
+                path += 1;
+            }
+            close_reporter(pack->reporter);
+            pack->reporter = open_reporter(kind, path);
+            if (pack->reporter == NULL) {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] could not open a '%s' reporter on '%s'\n", kind, path);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--shard") == 0) {
+            char *end = NULL;
+            if (i + 1 >= argc) {
+                report_error("expected i/N after '--shard'");
+                exit(1);
+            }
+            i += 1;
+            pack->shard_index = strtoul(argv[i], &end, 10);
+            pack->shard_count = *end == '/' ? strtoul(end + 1, &end, 10) : 0;
+            if (*end != '\0' || pack->shard_index == 0 || pack->shard_index > pack->shard_count) {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] '%s' is not a shard, expected i/N with 1 <= i <= N\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-t") == 0 || strcmp(argv[i], "--timeout") == 0) {
+            pack->timeout_ns = dial_number(argc, argv, &i)*1000000;
+        } else if (strcmp(argv[i], "-T") == 0 || strcmp(argv[i], "--suite-timeout") == 0) {
+            pack->suite_timeout_ns = dial_number(argc, argv, &i)*1000000;
+        } else if (strcmp(argv[i], "--cpu-limit") == 0) {
+            pack->cpu_limit = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--mem-limit") == 0) {
+            pack->as_limit = dial_number(argc, argv, &i)*1024*1024;
+        } else if (strcmp(argv[i], "--memo") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a path after '--memo'");
+                exit(1);
+            }
+            pack->memo_path = argv[++i];
+        } else if (strcmp(argv[i], "--memo-deps") == 0) {
+            char *end = NULL;
+            if (i + 1 >= argc) {
+                report_error("expected <hash>:<file> after '--memo-deps'");
+                exit(1);
+            }
+            i += 1;
+            uint64_t key = strtoull(argv[i], &end, 16);
+            if (end == argv[i] || *end != ':') {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] '%s' is not <hash>:<file>\n", argv[i]);
+                exit(1);
+            }
+            pack->dep_files = realloc(pack->dep_files, sizeof(char*)*(pack->num_dep_keys + 1));
+            pack->dep_keys = realloc(pack->dep_keys, sizeof(uint64_t)*(pack->num_dep_keys + 1));
+            pack->dep_files[pack->num_dep_keys] = end + 1;
+            pack->dep_keys[pack->num_dep_keys++] = key;
+        } else if (strcmp(argv[i], "--history") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a path after '--history'");
+                exit(1);
+            }
+            pack->history_path = argv[++i];
+        } else if (strcmp(argv[i], "--revision") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a revision after '--revision'");
+                exit(1);
+            }
+            pack->revision = argv[++i];
+            if (strlen(pack->revision) >= REVISION_CAP) {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] revision '%s' is longer than %d characters\n", pack->revision, REVISION_CAP - 1);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--compare") == 0) {
+            pack->compare = 1;
+            pack->min_slowdown = dial_number(argc, argv, &i);
+        } else if (strcmp(argv[i], "--baseline-runs") == 0) {
+            pack->baseline_runs = dial_number(argc, argv, &i);
+            if (pack->baseline_runs < BASELINE_MIN_RUNS) {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] a baseline needs at least %d runs\n", BASELINE_MIN_RUNS);
+                exit(1);
             }
+        } else if (strcmp(argv[i], "--baseline") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a revision after '--baseline'");
+                exit(1);
+            }
+            pack->baseline = argv[++i];
+            if (strlen(pack->baseline) >= REVISION_CAP) {
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] revision '%s' is longer than %d characters\n", pack->baseline, REVISION_CAP - 1);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "--build") == 0) {
+            if (i + 1 >= argc) {
+                report_error("expected a description after '--build'");
+                exit(1);
+            }
+            pack->build = argv[++i];
+        } else if (strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--isolate") == 0) {
+            pack->isolate = 1;
+        } else if (strcmp(argv[i], "--counters") == 0) {
+            pack->counters = 1;
+        } else if (strcmp(argv[i], "--leaks") == 0) {
+            pack->leaks = 1;
         } else {
-            printf("    "CLR";"SUCCESS"m >> success"RES"\n\n");
+            fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] unknown runner option '%s'\n", argv[i]);
+            exit(1);
         }
-        reset_burnt(burnt, -1);
-        struct timeval test_end = get_time_stamp();
-        slice->time = delta_time(test_start, test_end, &slice->time_unit); 
     }
-    struct timeval suite_end = get_time_stamp();
-    pack.time = delta_time(suite_start, suite_end, &pack.time_unit);
-    print_stats(&pack);
-    printf(" --- Toasts are done ---\n\n");
-    free(burnt);
-    return 0;
 }
 
-void burn_toast(BurntToast *burnt, char* diagnostic) {
-    burnt->yummy_or_burnt = BURNT;
-    burnt->diagnostic = diagnostic;
-    burnt->print_diagnostic = 1;
-}
-void eat_toast(BurntToast *burnt) {
-    burnt->yummy_or_burnt = YUMMY;
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+//Newton's method, so toast.h doesn't need libm
+static double toast_sqrt(double x) {
+    if (x <= 0.0) {
+        return 0.0;
+    }
+    double r = x > 1.0 ? x : 1.0;
+    for (int k = 0; k < 64; ++k) {
+        double next = 0.5*(r + x/r);
+        if (next >= r) {
+            break;
+        }
+        r = next;
+    }
+    return r;
+}
+
+//Times one call of a benchmark doing [iters] iterations
+static uint64_t time_bench(SliceOfToast *slice, BurntToast *burnt, uint64_t iters) {
+    uint64_t start = get_time_ns();
+    slice->bench(burnt, iters);
+    return get_time_ns() - start;
+}
+
+//Calibrates the iterations of a benchmark until a sample takes its share of 
+//[bench_time], then takes [bench_samples] samples.
+static void bake_bench(SliceOfToast *slice, BurntToast *burnt, PackOfToast *pack) {
+    size_t samples = pack->bench_samples;
+    uint64_t target = pack->bench_time/samples;
+    uint64_t iters = 1;
+    uint64_t elapsed = time_bench(slice, burnt, iters);
+    while (elapsed < target && burnt->yummy_or_burnt != BURNT) {
+        //aim a bit past the target, but don't overshoot on a noisy first sample
+        uint64_t next = elapsed > 0 ? (uint64_t)((double)iters*target/elapsed*1.2) : iters*100;
+        if (next > iters*100) {
+            next = iters*100;
+        }
+        iters = next > iters ? next : iters + 1;
+        elapsed = time_bench(slice, burnt, iters);
+    }
+
+    double *per_op = malloc(sizeof(double)*samples);
+    if (per_op == NULL) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    double sum = 0.0;
+    size_t taken = 0;
+    int counting = pack->counters && start_counters() == 0;
+    //like the counters, allocations are only tracked while sampling
+    alloc_slice = &slice->allocs;
+    for (; taken < samples && burnt->yummy_or_burnt != BURNT; ++taken) {
+        per_op[taken] = (double)time_bench(slice, burnt, iters)/iters;
+        sum += per_op[taken];
+    }
+    alloc_slice = NULL;
+    //without ops the counters are unavailable, they aren't shown as zeros
+    if (counting && stop_counters(&slice->counters) == 0) {
+        slice->counters.ops = iters*taken;
+    }
+    BenchStats *st = &slice->stats;
+    *st = (BenchStats){.iters = iters, .samples = taken};
+    if (taken > 0) {
+        qsort(per_op, taken, sizeof(double), cmp_double);
+        st->mean = sum/taken;
+        st->median = taken % 2 == 1 
+            ? per_op[taken/2] 
+            : (per_op[taken/2 - 1] + per_op[taken/2])/2.0;
+        st->p99 = per_op[(size_t)(0.99*(taken - 1) + 0.5)];
+        double var = 0.0;
+        for (size_t k = 0; k < taken; ++k) {
+            var += (per_op[k] - st->mean)*(per_op[k] - st->mean);
+        }
+        st->stddev = taken > 1 ? toast_sqrt(var/(taken - 1)) : 0.0;
+        st->ops_per_sec = st->mean > 0.0 ? 1e9/st->mean : 0.0;
+    }
+    free(per_op);
+    //a benchmark that didn't burn is done, even if it never ate its toast
+    if (burnt->yummy_or_burnt == RAW) {
+        burnt->yummy_or_burnt = YUMMY;
+    }
+}
+
+static void write_all(int fd, const char *bytes, size_t len) {
+    size_t off = 0;
+    while (off < len) {
+        ssize_t n = write(fd, bytes + off, len - off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            report_error(strerror(errno));
+            return;
+        }
+        off += n;
+    }
+}
+
+static void flush_writer(ToastWriter *w) {
+    write_all(w->fd, w->buf, w->len);
+    w->len = 0;
+}
+
+static void write_bytes(ToastWriter *w, const char *bytes, size_t len) {
+    if (w->len + len > w->cap) {
+        flush_writer(w);
+    }
+    if (len > w->cap) {
+        write_all(w->fd, bytes, len);
+        return;
+    }
+    memcpy(w->buf + w->len, bytes, len);
+    w->len += len;
+}
+
+static void write_str(ToastWriter *w, const char *str) {
+    write_bytes(w, str, strlen(str));
+}
+
+static void write_u64(ToastWriter *w, uint64_t value) {
+    char digits[24];
+    size_t i = sizeof(digits);
+    do {
+        digits[--i] = '0' + value%10;
+        value /= 10;
+    } while (value > 0);
+    write_bytes(w, digits + i, sizeof(digits) - i);
+}
+
+//Writes [str] as a JSON string, or null
+static void write_json(ToastWriter *w, const char *str) {
+    if (str == NULL) {
+        write_str(w, "null");
+        return;
+    }
+    write_bytes(w, "\"", 1);
+    const char *run = str;
+    for (const char *c = str; *c != '\0'; ++c) {
+        unsigned char ch = *c;
+        if (ch >= 0x20 && ch != '"' && ch != '\\') {
+            continue;
+        }
+        write_bytes(w, run, c - run);
+        run = c + 1;
+        char esc[8];
+        switch (ch) {
+            case '"':  write_str(w, "\\\""); break;
+            case '\\': write_str(w, "\\\\"); break;
+            case '\n': write_str(w, "\\n"); break;
+            case '\t': write_str(w, "\\t"); break;
+            default:
+                snprintf(esc, sizeof(esc), "\\u%04x", ch);
+                write_str(w, esc);
+        }
+    }
+    write_bytes(w, run, strlen(run));
+    write_bytes(w, "\"", 1);
+}
+
+static void write_xml(ToastWriter *w, const char *str) {
+    const char *run = str;
+    for (const char *c = str; c != NULL && *c != '\0'; ++c) {
+        const char *entity = NULL;
+        switch (*c) {
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '&': entity = "&amp;"; break;
+            case '"': entity = "&quot;"; break;
+            default:
+                if ((unsigned char)*c < 0x20 && *c != '\n' && *c != '\t') {
+                    entity = " ";
+                }
+        }
+        if (entity != NULL) {
+            write_bytes(w, run, c - run);
+            write_str(w, entity);
+            run = c + 1;
+        }
+    }
+    if (run != NULL) {
+        write_str(w, run);
+    }
+}
+
+static const char *outcome_name(SliceOfToast *slice) {
+    if (slice->result == RAW) {
+        return "not_run";
+    }
+    return slice->result > 0 ? "fail" : "pass";
+}
+
+//One JSON object per line and slice, e.g.
+//{"id":1,"name":"add","file":"./tests/foo.test.c","kind":"toast","outcome":"pass","diagnostic":null,"time_ns":42,...}
+static void report_jsonl(ToastReporter *self, size_t index, SliceOfToast *slice) {
+    ToastWriter *w = &self->writer;
+    write_str(w, "{\"id\":");
+    write_u64(w, index + 1);
+    write_str(w, ",\"name\":");
+    write_json(w, slice->name);
+    write_str(w, ",\"file\":");
+    write_json(w, slice->file);
+    if (slice->row_data != NULL) {
+        write_str(w, ",\"row\":");
+        write_u64(w, slice->row);
+    }
+    write_str(w, slice->bench != NULL ? ",\"kind\":\"bench\",\"outcome\":\"" 
+            : slice->fuzz != NULL ? ",\"kind\":\"fuzz\",\"outcome\":\"" : ",\"kind\":\"toast\",\"outcome\":\"");
+    write_str(w, outcome_name(slice));
+    write_str(w, "\",\"diagnostic\":");
+    write_json(w, slice->diagnostic);
+    write_str(w, ",\"time_ns\":");
+    write_u64(w, slice->time_ns);
+    write_str(w, ",\"user_ns\":");
+    write_u64(w, slice->usage.user_ns);
+    write_str(w, ",\"sys_ns\":");
+    write_u64(w, slice->usage.sys_ns);
+    if (slice->cached) {
+        write_str(w, ",\"cached\":true");
+    }
+    if (slice->bench != NULL && slice->result == YUMMY) {
+        char stats[128];
+        snprintf(stats, sizeof(stats), ",\"ns_per_op\":%.3f,\"iters\":%lu,\"samples\":%ld",
+                slice->stats.mean, (unsigned long)slice->stats.iters, slice->stats.samples);
+        write_str(w, stats);
+    }
+    ToastAllocs *a = &slice->allocs;
+    if (a->tracked && slice->result != RAW && !slice->cached) {
+        char allocs[192];
+        snprintf(allocs, sizeof(allocs), ",\"allocs\":%lu,\"frees\":%lu,\"alloc_bytes\":%lu,\"peak_bytes\":%lu,\"unfreed_bytes\":%lu",
+                (unsigned long)a->count, (unsigned long)a->frees, (unsigned long)a->bytes, 
+                (unsigned long)a->peak_bytes, (unsigned long)a->unfreed_bytes);
+        write_str(w, allocs);
+    }
+    ToastCounters *c = &slice->counters;
+    if (c->ops > 0) {
+        char counts[384];
+        snprintf(counts, sizeof(counts), ",\"ops\":%lu,\"task_clock_ns\":%lu,\"page_faults\":%lu,\"context_switches\":%lu",
+                (unsigned long)c->ops, (unsigned long)c->task_clock_ns, 
+                (unsigned long)c->page_faults, (unsigned long)c->context_switches);
+        write_str(w, counts);
+        if (c->hardware) {
+            snprintf(counts, sizeof(counts), ",\"cycles\":%lu,\"instructions\":%lu,\"ipc\":%.3f,\"branch_misses\":%lu,\"l1d_misses\":%lu,\"llc_misses\":%lu",
+                    (unsigned long)c->cycles, (unsigned long)c->instructions, 
+                    c->cycles > 0 ? (double)c->instructions/c->cycles : 0.0,
+                    (unsigned long)c->branch_misses, (unsigned long)c->l1d_misses, (unsigned long)c->llc_misses);
+            write_str(w, counts);
+        }
+    }
+    if (slice->fuzz != NULL && slice->result != RAW) {
+        char stats[128];
+        snprintf(stats, sizeof(stats), ",\"execs\":%lu,\"execs_per_sec\":%.0f,\"seed\":%lu",
+                (unsigned long)slice->fuzz_stats.execs, slice->fuzz_stats.execs_per_sec, 
+                (unsigned long)slice->fuzz_stats.seed);
+        write_str(w, stats);
+        if (slice->fuzz_stats.crash_path != NULL) {
+            write_str(w, ",\"input\":");
+            write_json(w, slice->fuzz_stats.crash_path);
+        }
+    }
+    write_str(w, "}\n");
+}
+
+static void begin_junit(ToastReporter *self, PackOfToast *pack) {
+    ToastWriter *w = &self->writer;
+    //failures aren't known before the end, consumers count the testcases
+    write_str(w, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<testsuites>\n  <testsuite name=\"");
+    write_xml(w, pack->brand);
+    write_str(w, "\" tests=\"");
+    write_u64(w, pack->size);
+    write_str(w, "\">\n");
+}
+
+static void report_junit(ToastReporter *self, size_t index, SliceOfToast *slice) {
+    (void)index;
+    ToastWriter *w = &self->writer;
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%.9f", slice->time_ns/1e9);
+    char label[256];
+    write_str(w, "    <testcase name=\"");
+    write_xml(w, slice_label(slice, label, sizeof(label)));
+    write_str(w, "\" classname=\"");
+    write_xml(w, slice->file != NULL ? slice->file : "toast");
+    write_str(w, "\" time=\"");
+    write_str(w, seconds);
+    ToastCounters *c = &slice->counters;
+    if (slice->result == YUMMY && c->ops == 0) {
+        write_str(w, "\"/>\n");
+        return;
+    }
+    write_str(w, "\">\n");
+    if (c->ops > 0) {
+        char props[512];
+        int n = snprintf(props, sizeof(props), "      <properties>\n"
+                "        <property name=\"ops\" value=\"%lu\"/>\n"
+                "        <property name=\"page_faults_per_op\" value=\"%.3f\"/>\n", 
+                (unsigned long)c->ops, (double)c->page_faults/c->ops);
+        if (c->hardware) {
+            snprintf(props + n, sizeof(props) - n, 
+                    "        <property name=\"ipc\" value=\"%.3f\"/>\n"
+                    "        <property name=\"branch_misses_per_op\" value=\"%.3f\"/>\n"
+                    "        <property name=\"l1d_misses_per_op\" value=\"%.3f\"/>\n"
+                    "        <property name=\"llc_misses_per_op\" value=\"%.3f\"/>\n",
+                    c->cycles > 0 ? (double)c->instructions/c->cycles : 0.0, (double)c->branch_misses/c->ops, 
+                    (double)c->l1d_misses/c->ops, (double)c->llc_misses/c->ops);
+        }
+        write_str(w, props);
+        write_str(w, "      </properties>\n");
+    }
+    if (slice->result == RAW) {
+        write_str(w, "      <skipped/>\n");
+    } else if (slice->result == BURNT) {
+        write_str(w, "      <failure message=\"");
+        write_xml(w, slice->diagnostic != NULL ? slice->diagnostic : "burnt");
+        write_str(w, "\"/>\n");
+    }
+    write_str(w, "    </testcase>\n");
+}
+
+static void end_junit(ToastReporter *self, PackOfToast *pack) {
+    (void)pack;
+    write_str(&self->writer, "  </testsuite>\n</testsuites>\n");
+    flush_writer(&self->writer);
+}
+
+static void end_jsonl(ToastReporter *self, PackOfToast *pack) {
+    (void)pack;
+    flush_writer(&self->writer);
+}
+
+ToastReporter *open_reporter(const char *kind, const char *path) {
+    ToastReporter reporter = {0};
+    if (strcmp(kind, "jsonl") == 0) {
+        reporter.report = report_jsonl;
+        reporter.end = end_jsonl;
+    } else if (strcmp(kind, "junit") == 0) {
+        reporter.begin = begin_junit;
+        reporter.report = report_junit;
+        reporter.end = end_junit;
+    } else {
+        return NULL;
+    }
+    reporter.writer.fd = strcmp(path, "-") == 0 
+        ? STDOUT_FILENO 
+        : open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (reporter.writer.fd < 0) {
+        return NULL;
+    }
+    reporter.writer.cap = REPORT_BUFFER_CAP;
+    reporter.writer.buf = malloc(REPORT_BUFFER_CAP);
+    ToastReporter *heap = malloc(sizeof(ToastReporter));
+    *heap = reporter;
+    return heap;
+}
+
+void close_reporter(ToastReporter *reporter) {
+    if (reporter == NULL) {
+        return;
+    }
+    if (reporter->writer.buf != NULL) {
+        flush_writer(&reporter->writer);
+        free(reporter->writer.buf);
+    }
+    if (reporter->writer.fd > STDERR_FILENO) {
+        close(reporter->writer.fd);
+    }
+    free(reporter);
+}
+
+//Inputs a fuzz target is replayed and mutated from
+typedef struct {
+    uint8_t *data;
+    size_t len;
+} FuzzInput;
+
+typedef struct {
+    FuzzInput *items;
+    size_t len;
+} FuzzCorpus;
+
+//splitmix64, small and good enough to pick mutations
+static uint64_t fuzz_rand(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30))*0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27))*0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static uint64_t hash_input(const uint8_t *data, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t b = 0; b < len; ++b) {
+        hash = (hash ^ data[b])*0x100000001b3;
+    }
+    return hash;
+}
+
+//Creates [path] and its parents, like mkdir -p
+static void make_dirs(const char *path) {
+    char dir[strlen(path) + 1];
+    memcpy(dir, path, sizeof(dir));
+    for (char *c = dir + 1; *c != '\0'; ++c) {
+        if (*c == '/') {
+            *c = '\0';
+            mkdir(dir, 0755);
+            *c = '/';
+        }
+    }
+    mkdir(dir, 0755);
+}
+
+//Reads every file in [dir], sorted by name, so a seed repeats a run. Inputs
+//longer than [max_len] are cut. A missing directory is an empty corpus.
+static FuzzCorpus load_corpus(const char *dir, size_t max_len) {
+    FuzzCorpus corpus = {0};
+    struct dirent **entries = NULL;
+    int n = scandir(dir, &entries, NULL, alphasort);
+    if (n <= 0) {
+        free(entries);
+        return corpus;
+    }
+    corpus.items = malloc(sizeof(FuzzInput)*n);
+    for (int e = 0; e < n; ++e) {
+        char path[strlen(dir) + strlen(entries[e]->d_name) + 2];
+        snprintf(path, sizeof(path), "%s/%s", dir, entries[e]->d_name);
+        free(entries[e]);
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            continue;
+        }
+        size_t len = (size_t)st.st_size < max_len ? (size_t)st.st_size : max_len;
+        uint8_t *data = malloc(len + 1);
+        ssize_t got = pread(fd, data, len, 0);
+        close(fd);
+        corpus.items[corpus.len++] = (FuzzInput){.data = data, .len = got > 0 ? (size_t)got : 0};
+    }
+    free(entries);
+    return corpus;
+}
+
+static void free_corpus(FuzzCorpus *corpus) {
+    for (size_t k = 0; k < corpus->len; ++k) {
+        free(corpus->items[k].data);
+    }
+    free(corpus->items);
+}
+
+//Applies one to eight random mutations to the [len] bytes in [buf], splicing
+//in bytes of other corpus inputs now and then. Returns the new length.
+static size_t mutate_input(uint8_t *buf, size_t len, size_t cap, FuzzCorpus *corpus, uint64_t *rng) {
+    static const uint8_t interesting[] = {0x00, 0x01, 0x7f, 0x80, 0xff, '0', '\n', ' '};
+    size_t rounds = 1 + fuzz_rand(rng) % 8;
+    for (size_t m = 0; m < rounds; ++m) {
+        uint64_t r = fuzz_rand(rng);
+        size_t op = len == 0 ? 3 : r % 8;
+        size_t at = len > 0 ? (r >> 8) % len : 0;
+        switch (op) {
+            case 0: //flip a bit
+                buf[at] ^= 1 << ((r >> 40) % 8);
+                break;
+            case 1: //random byte
+                buf[at] = r >> 40;
+                break;
+            case 2: //interesting byte
+                buf[at] = interesting[(r >> 40) % sizeof(interesting)];
+                break;
+            case 3: { //insert a few random bytes
+                size_t n = 1 + (r >> 40) % 4;
+                if (len + n > cap) {
+                    break;
+                }
+                memmove(buf + at + n, buf + at, len - at);
+                for (size_t b = 0; b < n; ++b) {
+                    buf[at + b] = fuzz_rand(rng);
+                }
+                len += n;
+                break;
+            }
+            case 4: { //erase a range
+                size_t n = 1 + (r >> 40) % (len - at);
+                memmove(buf + at, buf + at + n, len - at - n);
+                len -= n;
+                break;
+            }
+            case 5: { //copy a range over another part of the input
+                size_t from = (r >> 24) % len;
+                size_t n = 1 + (r >> 40) % (len - (at > from ? at : from));
+                memmove(buf + at, buf + from, n);
+                break;
+            }
+            case 6: //nudge a byte up or down
+                buf[at] += (r >> 40) % 2 == 0 ? 1 + (r >> 48) % 16 : -(1 + (r >> 48) % 16);
+                break;
+            case 7: { //splice in bytes of another input
+                if (corpus->len == 0) {
+                    break;
+                }
+                FuzzInput *other = &corpus->items[(r >> 24) % corpus->len];
+                if (other->len == 0) {
+                    break;
+                }
+                size_t from = (r >> 40) % other->len;
+                size_t n = other->len - from;
+                if (at + n > cap) {
+                    n = cap - at;
+                }
+                memcpy(buf + at, other->data + from, n);
+                len = at + n > len ? at + n : len;
+                break;
+            }
+        }
+    }
+    return len;
+}
+
+//Input the fuzz target is running on, saved by on_fuzz_crash if it crashes
+static const uint8_t *fuzz_input = NULL;
+static size_t fuzz_input_len = 0;
+//Path a crashing input is saved to, its hash is appended
+static char fuzz_crash_prefix[1024];
+//What fuzzing the target in progress did so far
+static const FuzzStats *fuzz_stats_now = NULL;
+
+//What fuzzing a slice did, as an isolated worker leaves it for the runner
+typedef struct {
+    FuzzStats stats;
+    //[stats.crash_path] is only valid in the worker, the path is copied here
+    char path[sizeof(fuzz_crash_prefix) + 17];
+} FuzzReport;
+
+//Where save_fuzz_crash reports a crash in an isolated worker, it points into
+//the table shared with the runner then
+static FuzzReport *fuzz_report = NULL;
+
+//write_all for signal handlers, gives up without a word
+static void write_quietly(int fd, const char *bytes, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, bytes, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return;
+        }
+        bytes += n;
+        len -= n;
+    }
+}
+
+//Saves the current input before the process dies, only async-signal-safe
+//calls in here
+static void save_fuzz_crash(void) {
+    if (fuzz_input == NULL) {
+        return;
+    }
+    char path[sizeof(fuzz_crash_prefix) + 17];
+    size_t n = strlen(fuzz_crash_prefix);
+    memcpy(path, fuzz_crash_prefix, n);
+    uint64_t hash = hash_input(fuzz_input, fuzz_input_len);
+    for (int d = 15; d >= 0; --d) {
+        path[n++] = "0123456789abcdef"[(hash >> (d*4)) & 0xf];
+    }
+    path[n] = '\0';
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        fuzz_input = NULL;
+        return;
+    }
+    write_quietly(fd, (const char*)fuzz_input, fuzz_input_len);
+    close(fd);
+    if (fuzz_report != NULL) {
+        if (fuzz_stats_now != NULL) {
+            fuzz_report->stats = *fuzz_stats_now;
+        }
+        fuzz_report->stats.execs++;
+        fuzz_report->stats.crash_len = fuzz_input_len;
+        fuzz_report->stats.found_len = fuzz_input_len;
+        memcpy(fuzz_report->path, path, n + 1);
+    }
+    const char *msg = "[TOAST]["ESC"31mERROR"RES"] fuzz target crashed, input saved to ";
+    write_quietly(STDERR_FILENO, msg, strlen(msg));
+    write_quietly(STDERR_FILENO, path, n);
+    write_quietly(STDERR_FILENO, "\n", 1);
+    fuzz_input = NULL;
+}
+
+static void on_fuzz_crash(int sig) {
+    save_fuzz_crash();
+    //the handler was reset, this ends the process as the signal would have
+    raise(sig);
+}
+
+//Sanitizers don't return to the signal handlers, they call this before they
+//exit. Only linked in when the suite is built with one.
+void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+//Runs the target on the input in [data], from the end of [exec_buf], so
+//reading past the input runs off the allocation. Returns whether it burnt.
+static int exec_fuzz(SliceOfToast *slice, BurntToast *burnt, const uint8_t *data, size_t len, uint8_t *exec_buf, size_t cap) {
+    uint8_t *input = exec_buf + cap - len;
+    memmove(input, data, len);
+    burnt->yummy_or_burnt = RAW;
+    burnt->print_diagnostic = 0;
+    fuzz_input = input;
+    fuzz_input_len = len;
+    alloc_slice = &slice->allocs;
+    slice->fuzz(burnt, input, len);
+    alloc_slice = NULL;
+    fuzz_input = NULL;
+    return burnt->yummy_or_burnt == BURNT;
+}
+
+//Takes chunks out of a failing input, halving their size, as long as the
+//target still burns without them. Returns the new length.
+static size_t minimize_input(SliceOfToast *slice, BurntToast *burnt, uint8_t *data, size_t len, uint8_t *exec_buf, size_t cap) {
+    uint8_t *scratch = malloc(cap + 1);
+    size_t tries = 0;
+    for (size_t chunk = len/2 > 0 ? len/2 : 1; chunk > 0 && tries < FUZZ_MINIMIZE_TRIES; chunk /= 2) {
+        for (size_t at = 0; at + chunk <= len && tries < FUZZ_MINIMIZE_TRIES; ++tries) {
+            memcpy(scratch, data, at);
+            memcpy(scratch + at, data + at + chunk, len - at - chunk);
+            if (exec_fuzz(slice, burnt, scratch, len - chunk, exec_buf, cap)) {
+                len -= chunk;
+                memcpy(data, scratch, len);
+            } else {
+                at += chunk;
+            }
+        }
+    }
+    free(scratch);
+    //leaves the diagnostic of the minimized input in [burnt]
+    exec_fuzz(slice, burnt, data, len, exec_buf, cap);
+    return len;
+}
+
+//Replays the corpus of a fuzz target, then runs it on mutations of the
+//corpus until it burns or its time or runs are up. A burning input is
+//minimized and saved, so it is replayed first from then on.
+static void bake_fuzz(SliceOfToast *slice, BurntToast *burnt, PackOfToast *pack) {
+    size_t cap = pack->fuzz_max_len > 0 ? pack->fuzz_max_len : 1;
+    FuzzStats *st = &slice->fuzz_stats;
+    *st = (FuzzStats){.seed = pack->fuzz_seed != 0 ? pack->fuzz_seed : get_time_ns()};
+    uint64_t rng = st->seed;
+    for (const char *c = slice->name; *c != '\0'; ++c) {
+        rng = (rng ^ (unsigned char)*c)*0x100000001b3;
+    }
+
+    char dir[sizeof(fuzz_crash_prefix)];
+    if (pack->corpus_path != NULL) {
+        snprintf(dir, sizeof(dir), "%s/%s", pack->corpus_path, slice->name);
+        snprintf(fuzz_crash_prefix, sizeof(fuzz_crash_prefix), "%s/%s/crash-", pack->corpus_path, slice->name);
+    } else {
+        snprintf(fuzz_crash_prefix, sizeof(fuzz_crash_prefix), "crash-%s-", slice->name);
+    }
+    FuzzCorpus corpus = pack->corpus_path != NULL ? load_corpus(dir, cap) : (FuzzCorpus){0};
+    st->corpus = corpus.len;
+    fuzz_stats_now = st;
+
+    uint8_t *work = malloc(cap + 1);
+    uint8_t *exec_buf = malloc(cap);
+    if (work == NULL || exec_buf == NULL) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    struct sigaction crash = {0}, prev[5];
+    const int crash_signals[5] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+    crash.sa_handler = on_fuzz_crash;
+    crash.sa_flags = SA_RESETHAND | SA_NODEFER;
+    if (pack->corpus_path != NULL) {
+        make_dirs(dir);
+    }
+    for (int k = 0; k < 5; ++k) {
+        sigaction(crash_signals[k], &crash, &prev[k]);
+    }
+    if (__sanitizer_set_death_callback != NULL) {
+        __sanitizer_set_death_callback(save_fuzz_crash);
+    }
+    //what was printed so far has to be out in case the target crashes
+    fflush(stdout);
+
+    uint64_t start = get_time_ns();
+    uint64_t deadline = pack->fuzz_time > 0 ? start + pack->fuzz_time : 0;
+    size_t len = 0;
+    int burnt_input = 0;
+    for (size_t k = 0; k < corpus.len && !burnt_input; ++k) {
+        len = corpus.items[k].len;
+        memcpy(work, corpus.items[k].data, len);
+        burnt_input = exec_fuzz(slice, burnt, work, len, exec_buf, cap);
+        st->execs++;
+    }
+    while (!burnt_input && (pack->fuzz_runs == 0 || st->execs < pack->fuzz_runs)) {
+        //the clock is only read every 256 inputs, reading it costs more than
+        //running a small target
+        if (deadline > 0 && st->execs % 256 == 0 && get_time_ns() >= deadline) {
+            break;
+        }
+        len = 0;
+        if (corpus.len > 0) {
+            FuzzInput *base = &corpus.items[fuzz_rand(&rng) % corpus.len];
+            len = base->len;
+            memcpy(work, base->data, len);
+        }
+        len = mutate_input(work, len, cap, &corpus, &rng);
+        burnt_input = exec_fuzz(slice, burnt, work, len, exec_buf, cap);
+        st->execs++;
+    }
+    uint64_t elapsed = get_time_ns() - start;
+    st->execs_per_sec = elapsed > 0 ? st->execs*1e9/elapsed : 0.0;
+
+    if (burnt_input) {
+        st->found_len = len;
+        st->crash_len = minimize_input(slice, burnt, work, len, exec_buf, cap);
+        char path[sizeof(fuzz_crash_prefix) + 17];
+        snprintf(path, sizeof(path), "%s%016llx", fuzz_crash_prefix, 
+                (unsigned long long)hash_input(work, st->crash_len));
+        int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] could not save failing input to '%s' (%s)\n", path, strerror(errno));
+        } else {
+            write_all(fd, (const char*)work, st->crash_len);
+            close(fd);
+            st->crash_path = strdup(path);
+        }
+        //a target that burns without a diagnostic still needs one
+        if (!burnt->print_diagnostic) {
+            burn_toast(burnt, "burnt on a generated input");
+        }
+    } else if (burnt->yummy_or_burnt == RAW) {
+        burnt->yummy_or_burnt = YUMMY;
+    }
+    for (int k = 0; k < 5; ++k) {
+        sigaction(crash_signals[k], &prev[k], NULL);
+    }
+    if (__sanitizer_set_death_callback != NULL) {
+        __sanitizer_set_death_callback(NULL);
+    }
+    fuzz_stats_now = NULL;
+    free_corpus(&corpus);
+    free(work);
+    free(exec_buf);
+}
+
+//Hands a finished slice to the reporter, callers hold the print lock
+static void report_slice(PackOfToast *pack, size_t index) {
+    if (pack->reporter != NULL && pack->reporter->report != NULL) {
+        pack->reporter->report(pack->reporter, index, &pack->slices[index]);
+    }
+    //stdout is fully buffered in a pipe, e.g. toaster's, the outcome goes out
+    //as it comes nevertheless
+    fflush(stdout);
+}
+
+//Tears down the fixtures that were set up, the last inserted first
+static void tear_down_fixtures(PackOfToast *pack) {
+    for (size_t f = pack->num_fixtures; f-- > 0;) {
+        ToastFixture *fixture = &pack->fixtures[f];
+        if (fixture->state == YUMMY && fixture->teardown != NULL) {
+            uint64_t start = get_time_ns();
+            fixture->teardown(fixture);
+            fixture->teardown_ns += get_time_ns() - start;
+        }
+        pthread_mutex_destroy(&fixture->lock);
+    }
+}
+
+//Checks what a slice allocated against its budget, and for leaks if the pack
+//asks for that
+static void settle_allocs(SliceOfToast *slice, BurntToast *burnt, PackOfToast *pack) {
+    ToastAllocs *allocs = &slice->allocs;
+    if (!allocs->tracked) {
+        return;
+    }
+    allocs->unfreed_bytes = allocs->live > 0 ? allocs->live : 0;
+    if (allocs->budgeted) {
+        allocs->spent_count = allocs->count - allocs->spent_count;
+        allocs->spent_bytes = allocs->bytes - allocs->spent_bytes;
+        if (allocs->spent_count > allocs->budget_count || allocs->spent_bytes > allocs->budget_bytes) {
+            burn_toast(burnt, "allocated more than its budget");
+        }
+    }
+    if (pack->leaks && allocs->unfreed_bytes > 0 && burnt->yummy_or_burnt != BURNT) {
+        burn_toast(burnt, "didn't free what it allocated");
+    }
+}
+
+//Runs a single slice and stores its result, diagnostic and time in it
+static void bake_slice(SliceOfToast *slice, BurntToast *burnt, size_t index, PackOfToast *pack) {
+    struct rusage usage_start;
+    get_usage(&usage_start);
+    uint64_t test_start = get_time_ns();
+    reset_burnt(burnt, index);
+    burnt->fixtures = pack->fixtures;
+    burnt->num_fixtures = pack->num_fixtures;
+    burnt->file = slice->file;
+    slice->counters = (ToastCounters){0};
+    slice->allocs = (ToastAllocs){.tracked = ALLOCS_TRACKED};
+    //benchmarks only count their samples
+    int counting = pack->counters && slice->bench == NULL && start_counters() == 0;
+    if (slice->bench != NULL) {
+        bake_bench(slice, burnt, pack);
+    } else if (slice->fuzz != NULL) {
+        bake_fuzz(slice, burnt, pack);
+    } else if (slice->param != NULL && slice->row_data == NULL) {
+        burn_toast(burnt, "no rows to run, the parameterized slice wasn't expanded");
+    } else if (slice->param != NULL) {
+        alloc_slice = &slice->allocs;
+        slice->param(burnt, slice->row_data);
+        alloc_slice = NULL;
+    } else {
+        alloc_slice = &slice->allocs;
+        slice->toast(burnt);
+        alloc_slice = NULL;
+    }
+    if (counting && stop_counters(&slice->counters) == 0) {
+        slice->counters.ops = slice->fuzz != NULL ? slice->fuzz_stats.execs : 1;
+    }
+    settle_allocs(slice, burnt, pack);
+    slice->result = burnt->yummy_or_burnt;
+    slice->diagnostic = burnt->print_diagnostic ? burnt->diagnostic : NULL;
+    //fixture setup is reported with the fixture, not the test using it
+    slice->time_ns = get_time_ns() - test_start - burnt->setup_ns;
+    struct rusage usage_end;
+    get_usage(&usage_end);
+    slice->usage = delta_usage(&usage_start, &usage_end);
+}
+
+static void print_title(SliceOfToast *slice, size_t index) {
+    char label[256];
+    printf("  %ld) %s\n", index+1, slice_label(slice, label, sizeof(label)));
+}
+
+static void print_outcome(SliceOfToast *slice) {
+    if (slice->result > 0) {
+        printf("    "CLR";"ERROR"m >> fail"RES"\n");
+        if (slice->diagnostic != NULL) {
+            printf("        Diagnostic: %s\n", slice->diagnostic);
+        }
+        FuzzStats *st = &slice->fuzz_stats;
+        if (slice->fuzz != NULL && st->execs > 0) {
+            printf("        Input:      %ld bytes (%ld as found) after %lu execs, seed %lu\n", 
+                    st->crash_len, st->found_len, (unsigned long)st->execs, (unsigned long)st->seed);
+        }
+        if (slice->fuzz != NULL && st->crash_path != NULL) {
+            printf("        Saved to:   %s\n", st->crash_path);
+        }
+        ToastAllocs *a = &slice->allocs;
+        if (a->budgeted && (a->spent_count > a->budget_count || a->spent_bytes > a->budget_bytes)) {
+            char count[48], bytes[48];
+            printf("        Budget:     %s allocs, %s bytes\n", 
+                    format_budget(a->spent_count, a->budget_count, count, sizeof(count)),
+                    format_budget(a->spent_bytes, a->budget_bytes, bytes, sizeof(bytes)));
+        }
+        if (a->unfreed_bytes > 0) {
+            printf("        Unfreed:    %lu bytes of %lu allocs\n", (unsigned long)a->unfreed_bytes, (unsigned long)a->count);
+        }
+        printf("\n");
+    } else {
+        if (slice->bench != NULL) {
+            printf("    "CLR";"SUCCESS"m >> %.2f ns/op (%lu iters x %ld samples)"RES"\n\n", 
+                    slice->stats.mean, (unsigned long)slice->stats.iters, slice->stats.samples);
+        } else if (slice->fuzz != NULL) {
+            printf("    "CLR";"SUCCESS"m >> %lu execs, %.0f execs/s (seed %lu, corpus %ld)"RES"\n\n", 
+                    (unsigned long)slice->fuzz_stats.execs, slice->fuzz_stats.execs_per_sec,
+                    (unsigned long)slice->fuzz_stats.seed, slice->fuzz_stats.corpus);
+        } else {
+            printf("    "CLR";"SUCCESS"m >> success"RES"\n\n");
+        }
+    }
+}
+
+//Work queue shared by the workers of `toast_parallel`. Workers claim the next
+//unclaimed slice, so slow tests don't hold back a statically assigned share.
+typedef struct {
+    PackOfToast *pack;
+    size_t next;
+    pthread_mutex_t print_lock;
+} ToastRack;
+
+//Claims the next slices from [next] for a worker, a single slice or up to
+//ROW_BATCH rows of the same parameterized slice. Returns the first, [end] is
+//past the last.
+static size_t claim_slices(PackOfToast *pack, size_t *next, size_t *end) {
+    size_t i = __atomic_load_n(next, __ATOMIC_RELAXED);
+    while (1) {
+        if (i >= pack->size) {
+            *end = i;
+            return i;
+        }
+        SliceOfToast *slice = &pack->slices[i];
+        size_t stop = i + 1;
+        if (slice->row_data != NULL) {
+            size_t last = i - slice->row + slice->rows->count;
+            stop = i + ROW_BATCH < last ? i + ROW_BATCH : last;
+        }
+        if (__atomic_compare_exchange_n(next, &i, stop, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            *end = stop;
+            return i;
+        }
+    }
+}
+
+static void *toast_worker(void *arg) {
+    ToastRack *rack = arg;
+    BurntToast burnt;
+    reset_burnt(&burnt, -1);
+    size_t next = 0, end = 0;
+    while (1) {
+        if (next == end) {
+            next = claim_slices(rack->pack, &rack->next, &end);
+        }
+        size_t i = next++;
+        if (i >= rack->pack->size) {
+            break;
+        }
+        SliceOfToast *slice = &rack->pack->slices[i];
+        if (runs_alone(slice) || slice->cached) {
+            continue;
+        }
+        bake_slice(slice, &burnt, i, rack->pack);
+        //name and outcome are printed together, so workers don't interleave
+        pthread_mutex_lock(&rack->print_lock);
+        print_title(slice, i);
+        print_outcome(slice);
+        report_slice(rack->pack, i);
+        pthread_mutex_unlock(&rack->print_lock);
+    }
+    close_counters();
+    return NULL;
+}
+
+static void run_parallel(PackOfToast *pack, size_t jobs) {
+    ToastRack rack = {
+        .pack = pack,
+        .next = 0,
+    };
+    pthread_mutex_init(&rack.print_lock, NULL);
+    pthread_t *workers = malloc(sizeof(pthread_t)*jobs);
+    if (workers == NULL) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    size_t started = 0;
+    for (; started < jobs; ++started) {
+        int err = pthread_create(&workers[started], NULL, toast_worker, &rack);
+        if (err != 0) {
+            //keep going with the workers we got, there is at least the caller
+            report_error(strerror(err));
+            break;
+        }
+    }
+    if (started == 0) {
+        toast_worker(&rack);
+    }
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+    pthread_mutex_destroy(&rack.print_lock);
+    free(workers);
+}
+
+//What the isolated workers did with a fixture, summed up over all of them
+typedef struct {
+    size_t setups;
+    size_t uses;
+    size_t failed;
+    uint64_t setup_ns;
+    uint64_t teardown_ns;
+} FixtureTally;
+
+//Result of a slice as written by an isolated worker into shared memory
+typedef struct {
+    int result;
+    uint64_t time_ns;
+    ToastUsage usage;
+    ToastCounters counters;
+    ToastAllocs allocs;
+    BenchStats stats;
+    FuzzReport fuzz;
+    char diagnostic[ERROR_BUFFER_CAP];
+} ToastRecord;
+
+#define IDLE_WORKER ((size_t)-1)
+
+typedef struct {
+    pid_t pid;
+    //index of the slice the worker is running or IDLE_WORKER
+    size_t current;
+    //when the worker started on [current]
+    uint64_t started_ns;
+    //slice the worker was killed for running too long, or IDLE_WORKER
+    size_t expired;
+    //slices the worker claimed, [next] is the one after [current]. Whatever
+    //is left of them when the worker dies is run by its replacement.
+    size_t next;
+    size_t end;
+} ToastWorker;
+
+//Shared between the runner and its forked workers. Workers claim slices from
+//[next], write results into [records] and send the finished index through a
+//pipe, so the runner can print slices as they come in.
+typedef struct {
+    size_t next;
+    //set once the suite ran out of time, no slice is claimed after that
+    int suite_expired;
+    //whether the workers run the slices that run alone instead of the tests
+    int alone;
+    size_t num_workers;
+    ToastWorker *workers;
+    ToastRecord *records;
+    //one per fixture of the pack
+    FixtureTally *tallies;
+    size_t mapped;
+} ToastTable;
+
+static const char *signal_name(int sig) {
+    switch (sig) {
+        case SIGSEGV: return "SIGSEGV";
+        case SIGABRT: return "SIGABRT";
+        case SIGBUS:  return "SIGBUS";
+        case SIGFPE:  return "SIGFPE";
+        case SIGILL:  return "SIGILL";
+        case SIGKILL: return "SIGKILL";
+        case SIGTERM: return "SIGTERM";
+        case SIGPIPE: return "SIGPIPE";
+        case SIGXCPU: return "SIGXCPU";
+        case SIGALRM: return "SIGALRM";
+        default:      return "signal";
+    }
+}
+
+static ToastTable *set_table(size_t num_slices, size_t num_workers, size_t num_fixtures) {
+    size_t size = sizeof(ToastTable) 
+        + sizeof(ToastWorker)*num_workers 
+        + sizeof(ToastRecord)*num_slices
+        + sizeof(FixtureTally)*num_fixtures;
+    ToastTable *table = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (table == MAP_FAILED) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    table->mapped = size;
+    table->num_workers = num_workers;
+    table->workers = (ToastWorker*)(table + 1);
+    table->records = (ToastRecord*)(table->workers + num_workers);
+    table->tallies = (FixtureTally*)(table->records + num_slices);
+    return table;
+}
+
+//Adds what a worker did with the fixtures to the table
+static void tally_fixtures(PackOfToast *pack, ToastTable *table) {
+    for (size_t f = 0; f < pack->num_fixtures; ++f) {
+        ToastFixture *fixture = &pack->fixtures[f];
+        FixtureTally *tally = &table->tallies[f];
+        __atomic_fetch_add(&tally->setups, fixture->setups, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&tally->uses, fixture->uses, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&tally->failed, fixture->state == BURNT, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&tally->setup_ns, fixture->setup_ns, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&tally->teardown_ns, fixture->teardown_ns, __ATOMIC_RELAXED);
+    }
+}
+
+//Adds the workers' fixture tallies to the fixtures of the runner
+static void serve_tallies(PackOfToast *pack, ToastTable *table) {
+    for (size_t f = 0; f < pack->num_fixtures; ++f) {
+        ToastFixture *fixture = &pack->fixtures[f];
+        FixtureTally *tally = &table->tallies[f];
+        fixture->setups += tally->setups;
+        fixture->uses += tally->uses;
+        fixture->setup_ns += tally->setup_ns;
+        fixture->teardown_ns += tally->teardown_ns;
+        if (tally->failed > 0) {
+            fixture->state = BURNT;
+        }
+    }
+}
+
+static void clear_table(ToastTable *table) {
+    munmap(table, table->mapped);
+}
+
+//Lets the next slice use [cpu_limit] more CPU seconds than the worker did so
+//far, RLIMIT_CPU counts for the whole process
+static void limit_cpu(uint64_t cpu_limit) {
+    struct rusage ru;
+    struct rlimit rl;
+    getrusage(RUSAGE_SELF, &ru);
+    getrlimit(RLIMIT_CPU, &rl);
+    rl.rlim_cur = ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + cpu_limit;
+    if (rl.rlim_max != RLIM_INFINITY && rl.rlim_cur > rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+    }
+    setrlimit(RLIMIT_CPU, &rl);
+}
+
+static void isolated_worker(PackOfToast *pack, ToastTable *table, ToastWorker *self, int done_fd) {
+    BurntToast burnt;
+    reset_burnt(&burnt, -1);
+    //counters opened by the runner would count the runner, not this worker
+    close_counters();
+    if (pack->as_limit > 0) {
+        struct rlimit rl = {.rlim_cur = pack->as_limit, .rlim_max = pack->as_limit};
+        if (setrlimit(RLIMIT_AS, &rl) < 0) {
+            report_error(strerror(errno));
+        }
+    }
+    while (1) {
+        if (self->next == self->end) {
+            self->next = claim_slices(pack, &table->next, &self->end);
+        }
+        size_t i = self->next++;
+        if (i >= pack->size) {
+            break;
+        }
+        SliceOfToast *slice = &pack->slices[i];
+        if (runs_alone(slice) != table->alone || slice->cached) {
+            continue;
+        }
+        if (pack->cpu_limit > 0 && !table->alone) {
+            limit_cpu(pack->cpu_limit);
+        }
+        ToastRecord *record = &table->records[i];
+        __atomic_store_n(&self->started_ns, get_time_ns(), __ATOMIC_RELAXED);
+        __atomic_store_n(&self->current, i, __ATOMIC_RELEASE);
+        fuzz_report = &record->fuzz;
+        bake_slice(slice, &burnt, i, pack);
+        fuzz_report = NULL;
+        record->result = slice->result;
+        record->time_ns = slice->time_ns;
+        record->usage = slice->usage;
+        record->counters = slice->counters;
+        record->allocs = slice->allocs;
+        record->stats = slice->stats;
+        record->fuzz.stats = slice->fuzz_stats;
+        if (slice->fuzz_stats.crash_path != NULL) {
+            snprintf(record->fuzz.path, sizeof(record->fuzz.path), "%s", slice->fuzz_stats.crash_path);
+        }
+        if (slice->diagnostic != NULL) {
+            snprintf(record->diagnostic, ERROR_BUFFER_CAP, "%s", slice->diagnostic);
+        }
+        __atomic_store_n(&self->current, IDLE_WORKER, __ATOMIC_RELEASE);
+        //test output has to be out before the runner prints the outcome
+        fflush(stdout);
+        if (write(done_fd, &i, sizeof(i)) != sizeof(i)) {
+            break;
+        }
+    }
+    tear_down_fixtures(pack);
+    tally_fixtures(pack, table);
+    fflush(stdout);
+    fflush(stderr);
+    //wakes up the runner, so it doesn't have to wait for poll to time out
+    size_t idle = IDLE_WORKER;
+    if (write(done_fd, &idle, sizeof(idle)) != sizeof(idle)) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+static pid_t spawn_worker(PackOfToast *pack, ToastTable *table, ToastWorker *self, int fds[2]) {
+    self->current = IDLE_WORKER;
+    self->expired = IDLE_WORKER;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        isolated_worker(pack, table, self, fds[1]);
+    }
+    if (pid < 0) {
+        report_error(strerror(errno));
+        return -1;
+    }
+    self->pid = pid;
+    return pid;
+}
+
+static void serve_record(PackOfToast *pack, ToastTable *table, size_t i) {
+    SliceOfToast *slice = &pack->slices[i];
+    ToastRecord *record = &table->records[i];
+    slice->result = record->result;
+    slice->time_ns = record->time_ns;
+    slice->usage = record->usage;
+    slice->counters = record->counters;
+    slice->allocs = record->allocs;
+    //the table is gone once the pack is done, the slice keeps its own copy
+    free(slice->diagnostic_copy);
+    slice->diagnostic_copy = record->diagnostic[0] != '\0' ? strdup(record->diagnostic) : NULL;
+    slice->diagnostic = slice->diagnostic_copy;
+    slice->stats = record->stats;
+    if (slice->fuzz != NULL) {
+        free(slice->fuzz_stats.crash_path);
+        slice->fuzz_stats = record->fuzz.stats;
+        slice->fuzz_stats.crash_path = record->fuzz.path[0] != '\0' ? strdup(record->fuzz.path) : NULL;
+    }
+    print_title(slice, i);
+    print_outcome(slice);
+    report_slice(pack, i);
+}
+
+//Marks the slice a dead worker was running as burnt
+static void bury_worker(PackOfToast *pack, ToastTable *table, ToastWorker *worker, int status) {
+    size_t i = __atomic_load_n(&worker->current, __ATOMIC_ACQUIRE);
+    worker->pid = 0;
+    if (i == IDLE_WORKER) {
+        return;
+    }
+    ToastRecord *record = &table->records[i];
+    record->result = BURNT;
+    if (worker->expired == i) {
+        uint64_t ran_ns = get_time_ns() - __atomic_load_n(&worker->started_ns, __ATOMIC_RELAXED);
+        record->time_ns = ran_ns;
+        if (table->suite_expired && (pack->timeout_ns == 0 || ran_ns < pack->timeout_ns)) {
+            snprintf(record->diagnostic, ERROR_BUFFER_CAP, "suite timeout after %.3fs", pack->suite_timeout_ns/1e9);
+        } else {
+            snprintf(record->diagnostic, ERROR_BUFFER_CAP, "timeout after %.3fs", pack->timeout_ns/1e9);
+        }
+    } else if (WIFSIGNALED(status) && WTERMSIG(status) == SIGXCPU && pack->cpu_limit > 0) {
+        snprintf(record->diagnostic, ERROR_BUFFER_CAP, "RLIMIT_CPU exceeded (%lus)", (unsigned long)pack->cpu_limit);
+    } else if (WIFSIGNALED(status) && pack->as_limit > 0) {
+        //a failed allocation under RLIMIT_AS usually ends in one of these
+        snprintf(record->diagnostic, ERROR_BUFFER_CAP, "killed by %s (%s), RLIMIT_AS exceeded? (%lu MiB)", 
+                signal_name(WTERMSIG(status)), strsignal(WTERMSIG(status)), 
+                (unsigned long)(pack->as_limit/(1024*1024)));
+    } else if (WIFSIGNALED(status)) {
+        snprintf(record->diagnostic, ERROR_BUFFER_CAP, "killed by %s (%s)", 
+                signal_name(WTERMSIG(status)), strsignal(WTERMSIG(status)));
+    } else {
+        snprintf(record->diagnostic, ERROR_BUFFER_CAP, "exited with status %d", 
+                WEXITSTATUS(status));
+    }
+    serve_record(pack, table, i);
+}
+
+static void drain_done(PackOfToast *pack, ToastTable *table, int fd) {
+    size_t done[64];
+    ssize_t n;
+    while ((n = read(fd, done, sizeof(done))) > 0) {
+        for (size_t k = 0; k < (size_t)n/sizeof(size_t); ++k) {
+            if (done[k] != IDLE_WORKER) {
+                serve_record(pack, table, done[k]);
+            }
+        }
+    }
+}
+
+//Kills workers whose slice ran past its timeout, and every worker once the
+//suite ran past [suite_deadline]. Their slices are burnt when they are buried.
+static void watch_workers(PackOfToast *pack, ToastTable *table, uint64_t suite_deadline) {
+    uint64_t now = get_time_ns();
+    int suite_over = suite_deadline > 0 && now >= suite_deadline && !table->suite_expired;
+    if (suite_over) {
+        table->suite_expired = 1;
+        __atomic_store_n(&table->next, pack->size, __ATOMIC_RELAXED);
+    }
+    for (size_t w = 0; w < table->num_workers; ++w) {
+        ToastWorker *worker = &table->workers[w];
+        size_t i = __atomic_load_n(&worker->current, __ATOMIC_ACQUIRE);
+        if (worker->pid <= 0 || i == IDLE_WORKER || worker->expired == i) {
+            continue;
+        }
+        uint64_t started = __atomic_load_n(&worker->started_ns, __ATOMIC_RELAXED);
+        if (suite_over || (pack->timeout_ns > 0 && now - started >= pack->timeout_ns)) {
+            worker->expired = i;
+            kill(worker->pid, SIGKILL);
+        }
+    }
+}
+
+//Self-pipe of the SIGCHLD handler. It is not the pipe of the workers, which
+//may be full while the runner is busy printing, and it never blocks.
+static int chld_fd = -1;
+
+//Wakes up the runner when a worker dies without saying goodbye
+static void on_chld(int sig) {
+    (void)sig;
+    int saved = errno;
+    char dead = 1;
+    if (write(chld_fd, &dead, 1) < 0) {
+        //a full pipe already wakes the runner, it polls with a timeout anyway
+    }
+    errno = saved;
+}
+
+//Returns the shared table, cleared once the pack is done. With [alone] the
+//workers run the benchmarks and fuzz targets instead of the tests, those
+//have their own time and aren't held to the timeouts and CPU limit.
+static ToastTable *run_isolated(PackOfToast *pack, size_t jobs, int alone) {
+    ToastTable *table = set_table(pack->size, jobs, pack->num_fixtures);
+    table->alone = alone;
+    int fds[2];
+    if (pipe(fds) < 0) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    int chld_fds[2];
+    if (pipe2(chld_fds, O_NONBLOCK | O_CLOEXEC) < 0) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    chld_fd = chld_fds[1];
+    struct sigaction chld = {0}, prev_chld;
+    chld.sa_handler = on_chld;
+    chld.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigaction(SIGCHLD, &chld, &prev_chld);
+
+    size_t alive = 0;
+    for (size_t w = 0; w < jobs; ++w) {
+        if (spawn_worker(pack, table, &table->workers[w], fds) > 0) {
+            alive++;
+        }
+    }
+    if (alive == 0) {
+        exit(1);
+    }
+
+    //the runner doubles as the watchdog, it never sleeps longer than 10ms
+    uint64_t suite_deadline = pack->suite_timeout_ns > 0 && !alone ? get_time_ns() + pack->suite_timeout_ns : 0;
+    struct pollfd pfds[2] = {{.fd = fds[0], .events = POLLIN}, {.fd = chld_fds[0], .events = POLLIN}};
+    while (alive > 0) {
+        if (poll(pfds, 2, 10) > 0) {
+            char dead[64];
+            while (read(chld_fds[0], dead, sizeof(dead)) > 0) {
+                //the dead are found by waitpid below
+            }
+            drain_done(pack, table, fds[0]);
+        }
+        if ((pack->timeout_ns > 0 && !alone) || suite_deadline > 0) {
+            watch_workers(pack, table, suite_deadline);
+        }
+        int status;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            //slices finished before the crash are still in the pipe
+            drain_done(pack, table, fds[0]);
+            for (size_t w = 0; w < jobs; ++w) {
+                ToastWorker *worker = &table->workers[w];
+                if (worker->pid != pid) {
+                    continue;
+                }
+                alive--;
+                bury_worker(pack, table, worker, status);
+                //the replacement starts with the rows the dead worker claimed
+                int left = worker->next < worker->end || __atomic_load_n(&table->next, __ATOMIC_RELAXED) < pack->size;
+                if (left && !table->suite_expired && spawn_worker(pack, table, worker, fds) > 0) {
+                    alive++;
+                }
+                break;
+            }
+        }
+    }
+    drain_done(pack, table, fds[0]);
+    sigaction(SIGCHLD, &prev_chld, NULL);
+    chld_fd = -1;
+    close(chld_fds[0]);
+    close(chld_fds[1]);
+    close(fds[0]);
+    close(fds[1]);
+    return table;
+}
+
+//Runs either the test cases or the slices that run alone of a pack on the
+//calling thread
+static void run_sequential(PackOfToast *pack, int alone) {
+    BurntToast *burnt = malloc(sizeof(BurntToast));
+    reset_burnt(burnt, -1);
+
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (runs_alone(slice) != alone || slice->cached) {
+            continue;
+        }
+        print_title(slice, i);
+        fflush(stdout);
+        bake_slice(slice, burnt, i, pack);
+        print_outcome(slice);
+        report_slice(pack, i);
+    }
+    free(burnt);
+}
+
+//Filters enclosed in slashes are POSIX extended regexes, anything else is a glob
+typedef struct {
+    const char *glob;
+    regex_t regex;
+} ToastFilter;
+
+static int filter_matches(ToastFilter *filter, const char *text) {
+    if (text == NULL) {
+        return 0;
+    }
+    if (filter->glob != NULL) {
+        return fnmatch(filter->glob, text, 0) == 0;
+    }
+    return regexec(&filter->regex, text, 0, NULL, 0) == 0;
+}
+
+//FNV-1a, stable across machines and runs so every node agrees on the shards
+static uint64_t hash_slice(SliceOfToast *slice) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (const char *c = slice->file; c != NULL && *c != '\0'; ++c) {
+        hash = (hash ^ (unsigned char)*c)*0x100000001b3;
+    }
+    for (const char *c = slice->name; c != NULL && *c != '\0'; ++c) {
+        hash = (hash ^ (unsigned char)*c)*0x100000001b3;
+    }
+    return hash;
+}
+
+typedef struct {
+    uint64_t hash;
+    size_t index;
+} ShardKey;
+
+static int cmp_shard_key(const void *a, const void *b) {
+    const ShardKey *x = a, *y = b;
+    if (x->hash != y->hash) {
+        return (x->hash > y->hash) - (x->hash < y->hash);
+    }
+    return (x->index > y->index) - (x->index < y->index);
+}
+
+//Keys only, a slice has one timing per run
+static int cmp_history_key(const void *a, const void *b) {
+    const ShardKey *x = a, *y = b;
+    return (x->hash > y->hash) - (x->hash < y->hash);
+}
+
+static int cmp_index(const void *a, const void *b) {
+    size_t x = *(const size_t*)a, y = *(const size_t*)b;
+    return (x > y) - (x < y);
+}
+
+//Indices of the slices passing the file selection, the filters and the shard
+static size_t *pick_slices(PackOfToast *pack, size_t *len) {
+    ToastFilter *filters = malloc(sizeof(ToastFilter)*(pack->num_filters + 1));
+    for (size_t f = 0; f < pack->num_filters; ++f) {
+        const char *pattern = pack->filters[f];
+        size_t pattern_len = strlen(pattern);
+        filters[f].glob = pattern;
+        if (pattern_len >= 2 && pattern[0] == '/' && pattern[pattern_len - 1] == '/') {
+            char re[pattern_len];
+            memcpy(re, pattern + 1, pattern_len - 2);
+            re[pattern_len - 2] = '\0';
+            int err = regcomp(&filters[f].regex, re, REG_EXTENDED | REG_NOSUB);
+            if (err != 0) {
+                char msg[ERROR_BUFFER_CAP];
+                regerror(err, &filters[f].regex, msg, sizeof(msg));
+                fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] bad filter '%s': %s\n", pattern, msg);
+                exit(1);
+            }
+            filters[f].glob = NULL;
+        }
+    }
+
+    size_t *indices = malloc(sizeof(size_t)*(pack->size + 1));
+    *len = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        int picked = pack->num_only_files == 0;
+        for (size_t f = 0; !picked && f < pack->num_only_files; ++f) {
+            picked = slice->file != NULL && strcmp(slice->file, pack->only_files[f]) == 0;
+        }
+        if (picked && pack->num_filters > 0) {
+            picked = 0;
+            for (size_t f = 0; !picked && f < pack->num_filters; ++f) {
+                picked = filter_matches(&filters[f], slice->name) || filter_matches(&filters[f], slice->file);
+            }
+        }
+        if (picked) {
+            indices[(*len)++] = i;
+        }
+    }
+
+    for (size_t f = 0; f < pack->num_filters; ++f) {
+        if (filters[f].glob == NULL) {
+            regfree(&filters[f].regex);
+        }
+    }
+    free(filters);
+
+    if (pack->shard_count > 0) {
+        //dealing the slices out in hash order keeps the shards the same size,
+        //and the same on every node, no matter the order slices were inserted
+        ShardKey *keys = malloc(sizeof(ShardKey)*(*len + 1));
+        for (size_t k = 0; k < *len; ++k) {
+            keys[k] = (ShardKey){.hash = hash_slice(&pack->slices[indices[k]]), .index = indices[k]};
+        }
+        qsort(keys, *len, sizeof(ShardKey), cmp_shard_key);
+        size_t dealt = 0;
+        for (size_t k = pack->shard_index - 1; k < *len; k += pack->shard_count) {
+            indices[dealt++] = keys[k].index;
+        }
+        *len = dealt;
+        free(keys);
+        qsort(indices, *len, sizeof(size_t), cmp_index);
+    }
+    return indices;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+//The memo is a sorted array of the keys of passed slices. A missing or
+//unreadable memo is an empty one.
+static uint64_t *load_memo(const char *path, size_t *len) {
+    *len = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    off_t size = lseek(fd, 0, SEEK_END);
+    uint64_t *keys = NULL;
+    if (size > 0 && size % sizeof(uint64_t) == 0) {
+        keys = malloc(size);
+        if (pread(fd, keys, size, 0) == size) {
+            *len = size/sizeof(uint64_t);
+        }
+    }
+    close(fd);
+    return keys;
+}
+
+//Memo key of a slice along with what its file included and the limits it
+//ran under, a pass without a timeout says nothing about one with it
+static uint64_t memo_key_of(PackOfToast *pack, SliceOfToast *slice) {
+    uint64_t limits[] = {pack->timeout_ns, pack->suite_timeout_ns, pack->cpu_limit, pack->as_limit, (uint64_t)pack->leaks};
+    uint64_t key = slice->memo_key;
+    for (size_t l = 0; l < sizeof(limits)/sizeof(limits[0]); ++l) {
+        key = (key ^ limits[l])*0x100000001b3;
+    }
+    for (size_t d = 0; slice->file != NULL && d < pack->num_dep_keys; ++d) {
+        if (strcmp(pack->dep_files[d], slice->file) == 0) {
+            return (key ^ pack->dep_keys[d])*0x100000001b3;
+        }
+    }
+    return key;
+}
+
+//Marks the slices whose key is in [memo] as passed, without running them
+static size_t serve_memo(PackOfToast *pack, uint64_t *memo, size_t len) {
+    size_t served = 0;
+    for (size_t i = 0; len > 0 && i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (runs_alone(slice) || slice->memo_key == 0) {
+            continue;
+        }
+        uint64_t key = memo_key_of(pack, slice);
+        if (bsearch(&key, memo, len, sizeof(uint64_t), cmp_u64) != NULL) {
+            slice->result = YUMMY;
+            slice->cached = 1;
+            served++;
+        }
+    }
+    return served;
+}
+
+//Writes back [memo] with the keys of slices that passed now and without those
+//that failed. Slices the run didn't touch keep their keys.
+static void save_memo(PackOfToast *pack, uint64_t *memo, size_t len) {
+    uint64_t *burnt = malloc(sizeof(uint64_t)*(pack->size + 1));
+    uint64_t *keys = malloc(sizeof(uint64_t)*(len + pack->size + 1));
+    size_t num_burnt = 0;
+    size_t num_keys = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (runs_alone(slice) || slice->memo_key == 0) {
+            continue;
+        }
+        if (slice->result == YUMMY) {
+            keys[num_keys++] = memo_key_of(pack, slice);
+        } else if (slice->result == BURNT) {
+            burnt[num_burnt++] = memo_key_of(pack, slice);
+        }
+    }
+    qsort(burnt, num_burnt, sizeof(uint64_t), cmp_u64);
+    for (size_t k = 0; k < len; ++k) {
+        if (num_burnt == 0 || bsearch(&memo[k], burnt, num_burnt, sizeof(uint64_t), cmp_u64) == NULL) {
+            keys[num_keys++] = memo[k];
+        }
+    }
+    qsort(keys, num_keys, sizeof(uint64_t), cmp_u64);
+    size_t unique = 0;
+    for (size_t k = 0; k < num_keys; ++k) {
+        if (unique == 0 || keys[unique - 1] != keys[k]) {
+            keys[unique++] = keys[k];
+        }
+    }
+
+    //written next to the memo and moved over it, so a crash never leaves half
+    char part_path[strlen(pack->memo_path) + 8];
+    snprintf(part_path, sizeof(part_path), "%s.part", pack->memo_path);
+    int fd = open(part_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        report_error(strerror(errno));
+    } else {
+        write_all(fd, (const char*)keys, unique*sizeof(uint64_t));
+        close(fd);
+        if (rename(part_path, pack->memo_path) < 0) {
+            report_error(strerror(errno));
+        }
+    }
+    free(keys);
+    free(burnt);
+}
+
+//The history file starts with this header, the records follow until its end.
+//Records are only ever appended, so the file can be mapped and read as an
+//array.
+typedef struct {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t reserved;
+} ToastHistoryHeader;
+
+#define HISTORY_MAGIC "TOASTHI1"
+
+//Timing of a slice in one run
+typedef struct {
+    //hash_slice of the slice, mixed with the row of an expanded slice
+    uint64_t key;
+    //Wall clock time in ns the run started at, shared by its records
+    uint64_t run;
+    char revision[REVISION_CAP];
+    //Time in ns, ns per op for a benchmark, and its stddev
+    double value;
+    double stddev;
+    uint32_t samples;
+    uint32_t bench;
+} ToastHistory;
+
+static uint64_t history_key(SliceOfToast *slice) {
+    uint64_t hash = hash_slice(slice);
+    if (slice->row_data != NULL) {
+        hash = (hash ^ slice->row)*0x100000001b3;
+    }
+    return hash;
+}
+
+//Only passes have a timing worth keeping, fuzz targets run as long as they
+//are told to
+static int has_history(SliceOfToast *slice) {
+    return slice->result == YUMMY && !slice->cached && slice->fuzz == NULL;
+}
+
+static double history_value(SliceOfToast *slice) {
+    return slice->bench != NULL ? slice->stats.mean : (double)slice->time_ns;
+}
+
+//Appends a record per timed slice with a single write. The file gets its
+//header if it is new, a history with other records is left alone. Shards
+//running at the same time take turns, otherwise two could both find the file
+//empty and write its header.
+static void append_history(PackOfToast *pack, uint64_t run) {
+    int fd = open(pack->history_path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (fd < 0 || flock(fd, LOCK_EX) < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] could not open history '%s' (%s)\n", pack->history_path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    ToastHistoryHeader header = {.magic = HISTORY_MAGIC, .record_size = sizeof(ToastHistory)};
+    ToastHistoryHeader found;
+    if (st.st_size > 0 && (pread(fd, &found, sizeof(found), 0) != sizeof(found) 
+            || memcmp(found.magic, header.magic, sizeof(header.magic)) != 0 || found.record_size != header.record_size)) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] '%s' is not a history of this version of toast, not appending\n", pack->history_path);
+        close(fd);
+        return;
+    }
+    ToastHistory *records = calloc(pack->size + 1, sizeof(ToastHistory));
+    size_t len = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (!has_history(slice)) {
+            continue;
+        }
+        ToastHistory *record = &records[len++];
+        record->key = history_key(slice);
+        record->run = run;
+        snprintf(record->revision, sizeof(record->revision), "%s", pack->revision != NULL ? pack->revision : "");
+        record->value = history_value(slice);
+        record->stddev = slice->bench != NULL ? slice->stats.stddev : 0.0;
+        record->samples = slice->bench != NULL ? slice->stats.samples : 1;
+        record->bench = slice->bench != NULL;
+    }
+    if (st.st_size == 0) {
+        write_all(fd, (const char*)&header, sizeof(header));
+    }
+    write_all(fd, (const char*)records, len*sizeof(ToastHistory));
+    free(records);
+    close(fd);
+}
+
+//Maps the records of the history at [path]. Returns NULL if there is none
+//yet or it isn't a history of this version of toast.
+static const ToastHistory *map_history(const char *path, size_t *len, size_t *mapped) {
+    *len = 0;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ToastHistoryHeader)) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        report_error(strerror(errno));
+        return NULL;
+    }
+    const ToastHistoryHeader *header = map;
+    if (memcmp(header->magic, HISTORY_MAGIC, sizeof(header->magic)) != 0 || header->record_size != sizeof(ToastHistory)) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] '%s' is not a history of this version of toast\n", path);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    *mapped = st.st_size;
+    //a record cut short by a crash while appending is left out
+    *len = (st.st_size - sizeof(ToastHistoryHeader))/sizeof(ToastHistory);
+    return (const ToastHistory*)(header + 1);
+}
+
+//Median of [values], which get sorted
+static double median_of(double *values, size_t len) {
+    qsort(values, len, sizeof(double), cmp_double);
+    return len % 2 == 1 ? values[len/2] : (values[len/2 - 1] + values[len/2])/2.0;
+}
+
+static const char *format_history(SliceOfToast *slice, double value, char *buf, size_t cap) {
+    if (slice->bench != NULL) {
+        snprintf(buf, cap, "%.2fns/op", value);
+        return buf;
+    }
+    return format_ns((uint64_t)value, buf, cap);
+}
+
+//Compares the timing of every slice against its last [baseline_runs] runs in
+//the history. Single timings are noisy and their spread differs from slice to
+//slice, so a slice only regressed if its timing is an outlier of the window,
+//by a modified z-score on the median and MAD (robust against the odd slow run
+//in the window itself), and slower than the median by more than
+//[min_slowdown] percent. Returns the number of regressions.
+static size_t compare_history(PackOfToast *pack) {
+    size_t len = 0, mapped = 0;
+    const ToastHistory *history = map_history(pack->history_path, &len, &mapped);
+    size_t window = pack->baseline_runs;
+    //keys of the timed slices in hash order, records find theirs with bsearch
+    ShardKey *keys = malloc(sizeof(ShardKey)*(pack->size + 1));
+    size_t num_keys = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        if (has_history(&pack->slices[i])) {
+            keys[num_keys++] = (ShardKey){.hash = history_key(&pack->slices[i]), .index = i};
+        }
+    }
+    qsort(keys, num_keys, sizeof(ShardKey), cmp_shard_key);
+    double *values = malloc(sizeof(double)*(num_keys*window + 1));
+    double *devs = malloc(sizeof(double)*window);
+    size_t *taken = calloc(num_keys + 1, sizeof(size_t));
+    //newest first, the window holds the most recent runs
+    for (size_t r = len; r-- > 0 && num_keys > 0;) {
+        const ToastHistory *record = &history[r];
+        if (pack->baseline != NULL && strcmp(record->revision, pack->baseline) != 0) {
+            continue;
+        }
+        ShardKey probe = {.hash = record->key};
+        ShardKey *found = bsearch(&probe, keys, num_keys, sizeof(ShardKey), cmp_history_key);
+        if (found != NULL) {
+            size_t k = found - keys;
+            if (taken[k] < window) {
+                values[k*window + taken[k]++] = record->value;
+            }
+        }
+    }
+
+    size_t compared = 0, regressions = 0;
+    for (size_t k = 0; k < num_keys; ++k) {
+        if (taken[k] < BASELINE_MIN_RUNS) {
+            continue;
+        }
+        compared++;
+        SliceOfToast *slice = &pack->slices[keys[k].index];
+        double now = history_value(slice);
+        double *base = &values[k*window];
+        double median = median_of(base, taken[k]);
+        double mean_dev = 0.0;
+        for (size_t v = 0; v < taken[k]; ++v) {
+            devs[v] = base[v] > median ? base[v] - median : median - base[v];
+            mean_dev += devs[v]/taken[k];
+        }
+        double mad = median_of(devs, taken[k]);
+        //the MAD is 0 once half the window is equal, the mean absolute
+        //deviation stands in for it then (Iglewicz and Hoaglin)
+        double z = mad > 0.0 ? 0.6745*(now - median)/mad
+            : mean_dev > 0.0 ? (now - median)/(1.253314*mean_dev)
+            : now > median ? __builtin_inf() : 0.0;
+        double slowdown = median > 0.0 ? (now/median - 1.0)*100.0 : 0.0;
+        if (z <= REGRESSION_Z || slowdown <= (double)pack->min_slowdown) {
+            continue;
+        }
+        if (regressions++ == 0) {
+            printf("  ++ "ESC"1mRegressions"RES"\n\n");
+            printf("           | Test Id | Test Name     | Now            | Median         | MAD            | Slowdown | Z-Score |\n");
+            printf("           | ======= | ============= | ============== | ============== | ============== | ======== | ======= |\n");
+        }
+        char label[256], now_s[32], median_s[32], mad_s[32], slowdown_s[16];
+        snprintf(slowdown_s, sizeof(slowdown_s), "+%.1f%%", slowdown);
+        printf("           | %-8ld| %-14.13s| %-15s| %-15s| %-15s| "CLR";"ERROR"m%-9s"RES"| %-8.1f|\n",
+                keys[k].index + 1, slice_label(slice, label, sizeof(label)),
+                format_history(slice, now, now_s, sizeof(now_s)),
+                format_history(slice, median, median_s, sizeof(median_s)),
+                format_history(slice, mad, mad_s, sizeof(mad_s)), slowdown_s, z);
+        printf("           | ------- | ------------- | -------------- | -------------- | -------------- | -------- | ------- |\n");
+    }
+    if (regressions > 0) {
+        printf("\n");
+    }
+    printf("     Compared %ld of %ld timed toasts against up to %ld earlier runs", compared, num_keys, window);
+    if (pack->baseline != NULL) {
+        printf(" of '%s'", pack->baseline);
+    }
+    printf("\n");
+    if (regressions > 0) {
+        printf("     "CLR";"ERROR"mRegressed:        %ld"RES" (outliers more than %lu%% slower)\n", regressions, (unsigned long)pack->min_slowdown);
+    } else {
+        printf("     "CLR";"SUCCESS"mRegressed:        0"RES"\n");
+    }
+    printf("\n");
+    free(taken);
+    free(devs);
+    free(values);
+    free(keys);
+    if (history != NULL) {
+        munmap((char*)history - sizeof(ToastHistoryHeader), mapped);
+    }
+    return regressions;
+}
+
+//Maps the file of [rows] unless they are there already. CSV files get an
+//index of their non-empty lines, the lines themselves stay in the mapping.
+static int load_rows(ToastRows *rows) {
+    if (rows->data != NULL || rows->path == NULL) {
+        return rows->data != NULL || rows->count == 0 ? 0 : -1;
+    }
+    int fd = open(rows->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] could not open rows '%s' (%s)\n", rows->path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    rows->map_len = st.st_size;
+    rows->map = st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (rows->map == MAP_FAILED) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] could not map rows '%s' (%s)\n", rows->path, strerror(errno));
+        rows->map = NULL;
+        return -1;
+    }
+    rows->data = rows->map;
+    if (rows->stride > 0) {
+        rows->count = rows->map_len/rows->stride;
+        return 0;
+    }
+    const char *p = rows->map, *end = p + rows->map_len;
+    size_t cap = 0;
+    rows->count = 0;
+    while (p < end) {
+        const char *nl = memchr(p, '\n', end - p);
+        const char *stop = nl != NULL ? nl : end;
+        size_t len = stop - p;
+        if (len > 0 && p[len - 1] == '\r') {
+            len--;
+        }
+        if (len > 0) {
+            if (rows->count == cap) {
+                cap = cap == 0 ? 256 : cap*2;
+                rows->lines = realloc(rows->lines, sizeof(ToastLine)*cap);
+            }
+            rows->lines[rows->count++] = (ToastLine){.start = p, .len = len};
+        }
+        p = stop + 1;
+    }
+    return 0;
+}
+
+static void unload_rows(ToastRows *rows) {
+    if (rows->map == NULL) {
+        return;
+    }
+    munmap(rows->map, rows->map_len);
+    free(rows->lines);
+    *rows = (ToastRows){.path = rows->path, .stride = rows->stride};
+}
+
+static const void *row_at(ToastRows *rows, size_t row) {
+    if (rows->stride == 0) {
+        return &rows->lines[row];
+    }
+    return (const char*)rows->data + row*rows->stride;
+}
+
+static int is_unexpanded(SliceOfToast *slice) {
+    return slice->param != NULL && slice->row_data == NULL && slice->rows != NULL;
+}
+
+//Replaces every parameterized slice with one slice per row, pointing at the
+//row. Returns the slices the pack had before, or NULL if there was nothing
+//to expand, and the number of expanded slices in [expanded]. A slice whose
+//rows can't be loaded stays as it is and burns.
+static SliceOfToast *expand_rows(PackOfToast *pack, size_t *expanded) {
+    size_t total = 0;
+    *expanded = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &pack->slices[i];
+        if (is_unexpanded(slice) && load_rows(slice->rows) == 0 && slice->rows->count > 0) {
+            total += slice->rows->count;
+            *expanded += 1;
+        } else {
+            total += 1;
+        }
+    }
+    if (*expanded == 0) {
+        return NULL;
+    }
+    SliceOfToast *given = pack->slices;
+    SliceOfToast *slices = malloc(sizeof(SliceOfToast)*total);
+    if (slices == NULL) {
+        report_error(strerror(errno));
+        exit(1);
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < pack->size; ++i) {
+        SliceOfToast *slice = &given[i];
+        if (!is_unexpanded(slice) || slice->rows->count == 0) {
+            slices[n++] = *slice;
+            continue;
+        }
+        for (size_t r = 0; r < slice->rows->count; ++r) {
+            SliceOfToast row = *slice;
+            row.diagnostic_copy = NULL;
+            row.row = r;
+            row.row_data = row_at(slice->rows, r);
+            //a row passes as long as the test and the row itself don't change
+            const unsigned char *bytes = slice->rows->stride == 0 
+                ? (const unsigned char*)slice->rows->lines[r].start : row.row_data;
+            size_t len = slice->rows->stride == 0 ? slice->rows->lines[r].len : slice->rows->stride;
+            for (size_t b = 0; row.memo_key != 0 && b < len; ++b) {
+                row.memo_key = (row.memo_key ^ bytes[b])*0x100000001b3;
+            }
+            slices[n++] = row;
+        }
+    }
+    pack->slices = slices;
+    pack->size = total;
+    pack->cap = total;
+    return given;
+}
+
+//Writes the results of the expanded slices back to the slices they came
+//from. A parameterized slice burns if any of its rows did, its time is the
+//sum of theirs.
+static void fold_rows(PackOfToast *pack, SliceOfToast *given, size_t given_size) {
+    size_t n = 0;
+    for (size_t i = 0; i < given_size; ++i) {
+        SliceOfToast *slice = &given[i];
+        if (!is_unexpanded(slice) || slice->rows->count == 0) {
+            *slice = pack->slices[n++];
+            continue;
+        }
+        slice->result = RAW;
+        slice->time_ns = 0;
+        slice->cached = 1;
+        slice->diagnostic = NULL;
+        free(slice->diagnostic_copy);
+        slice->diagnostic_copy = NULL;
+        for (size_t r = 0; r < slice->rows->count; ++r) {
+            SliceOfToast *row = &pack->slices[n++];
+            slice->time_ns += row->time_ns;
+            slice->cached &= row->cached;
+            if (row->result == BURNT && slice->result != BURNT) {
+                slice->result = BURNT;
+                slice->diagnostic = row->diagnostic;
+                //the copy moves over to the slice along with the diagnostic
+                slice->diagnostic_copy = row->diagnostic_copy;
+                row->diagnostic_copy = NULL;
+            } else if (row->result == YUMMY && slice->result == RAW) {
+                slice->result = YUMMY;
+            }
+            free(row->diagnostic_copy);
+        }
+        unload_rows(slice->rows);
+    }
+}
+
+//Runs every slice of the pack
+static int bake_pack(PackOfToast pack) {
+    uint64_t suite_start = get_time_ns();
+    //records of a run share the wall clock time it started at
+    struct timespec run_start;
+    clock_gettime(CLOCK_REALTIME, &run_start);
+    size_t given_size = pack.size;
+    size_t expanded = 0;
+    SliceOfToast *given = expand_rows(&pack, &expanded);
+
+    size_t jobs = pack.jobs;
+    if (jobs == AUTO_JOBS) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = online > 0 ? (size_t)online : 1;
+    }
+    if (jobs > pack.size) {
+        jobs = pack.size > 0 ? pack.size : 1;
+    }
+    //a hanging thread can't be stopped, a hanging process can
+    if (pack.timeout_ns > 0 || pack.suite_timeout_ns > 0 || pack.cpu_limit > 0 || pack.as_limit > 0) {
+        pack.isolate = 1;
+    }
+
+    if (pack.build != NULL) {
+        printf("\n\n +++ "ESC"1mTOASTER BRAND: %s"RES" [%s] +++\n", pack.brand, pack.build);
+    } else {
+        printf("\n\n +++ "ESC"1mTOASTER BRAND: %s"RES" +++\n", pack.brand);
+    }     
+    printf("     Inserted %ld toasts\n", given_size);
+    if (expanded > 0) {
+        printf("     Expanded %ld parameterized toasts into %ld rows\n", expanded, pack.size - (given_size - expanded));
+    }
+    uint64_t *memo = NULL;
+    size_t memo_len = 0;
+    size_t served = 0;
+    //a comparison of cached passes would compare nothing
+    if (pack.memo_path != NULL) {
+        memo = load_memo(pack.memo_path, &memo_len);
+        served = pack.compare ? 0 : serve_memo(&pack, memo, memo_len);
+    }
+    if (served > 0) {
+        printf("     Serving %ld cached passes\n", served);
+    }
+    if (pack.compare && pack.history_path == NULL) {
+        report_error("--compare needs a --history to compare against");
+        pack.compare = 0;
+    }
+    if (pack.shard_count > 0) {
+        printf("     Toasting shard %ld/%ld\n", pack.shard_index, pack.shard_count);
+    }
+    if (pack.counters && open_counters() < 0) {
+        fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] can't count, perf_event_open failed (%s)\n", strerror(errno));
+        pack.counters = 0;
+    } else if (pack.counters && counter_group.hardware) {
+        printf("     Counting cycles, instructions, branch and cache misses\n");
+    } else if (pack.counters) {
+        printf("     Counting task-clock, page faults and context switches, the PMU can't be accessed\n");
+    }
+    if (pack.isolate) {
+        printf("     Toasting on %ld isolated workers\n", jobs);
+    } else if (jobs > 1) {
+        printf("     Toasting on %ld workers\n", jobs);
+    }
+    printf("\n");
+
+    for (size_t f = 0; f < pack.num_fixtures; ++f) {
+        pthread_mutex_init(&pack.fixtures[f].lock, NULL);
+    }
+    if (pack.reporter != NULL && pack.reporter->begin != NULL) {
+        pack.reporter->begin(pack.reporter, &pack);
+    }
+    for (size_t i = 0; served > 0 && i < pack.size; ++i) {
+        if (pack.slices[i].cached) {
+            report_slice(&pack, i);
+        }
+    }
+    ToastTable *table = NULL, *alone_table = NULL;
+    if (pack.isolate) {
+        table = run_isolated(&pack, jobs, 0);
+    } else if (jobs > 1) {
+        run_parallel(&pack, jobs);
+    } else {
+        run_sequential(&pack, 0);
+    }
+    size_t alone = 0;
+    for (size_t i = 0; i < pack.size; ++i) {
+        alone += runs_alone(&pack.slices[i]) && !pack.slices[i].cached;
+    }
+    //benchmarks and fuzz targets run one at a time once the tests are done,
+    //so they don't compete with the workers for cores. Isolated, they get a
+    //worker of their own, a crashing target must not take the runner down.
+    if (table == NULL) {
+        run_sequential(&pack, 1);
+    } else if (!table->suite_expired && alone > 0) {
+        alone_table = run_isolated(&pack, 1, 1);
+    } else if (table->suite_expired) {
+        //reporters still hear of the slices that never got to run
+        for (size_t i = 0; i < pack.size; ++i) {
+            if (pack.slices[i].result == RAW) {
+                report_slice(&pack, i);
+            }
+        }
+    }
+    tear_down_fixtures(&pack);
+    close_counters();
+    if (table != NULL) {
+        serve_tallies(&pack, table);
+    }
+    if (alone_table != NULL) {
+        serve_tallies(&pack, alone_table);
+    }
+    pack.time_ns = get_time_ns() - suite_start;
+    if (pack.memo_path != NULL) {
+        save_memo(&pack, memo, memo_len);
+        free(memo);
+    }
+    if (pack.reporter != NULL && pack.reporter->end != NULL) {
+        pack.reporter->end(pack.reporter, &pack);
+    }
+    print_stats(&pack);
+    size_t regressions = 0;
+    if (pack.history_path != NULL && pack.compare) {
+        regressions = compare_history(&pack);
+    }
+    if (pack.history_path != NULL) {
+        append_history(&pack, (uint64_t)run_start.tv_sec*1000000000 + (uint64_t)run_start.tv_nsec);
+    }
+    printf(" --- Toasts are done ---\n\n");
+    if (given != NULL) {
+        fold_rows(&pack, given, given_size);
+        free(pack.slices);
+    }
+    if (table != NULL) {
+        clear_table(table);
+    }
+    if (alone_table != NULL) {
+        clear_table(alone_table);
+    }
+    return regressions > 0;
+}
+
+int toast(PackOfToast pack) {
+    if (pack.num_only_files == 0 && pack.num_filters == 0 && pack.shard_count == 0) {
+        return bake_pack(pack);
+    }
+    size_t len = 0;
+    size_t *indices = pick_slices(&pack, &len);
+    int result = toast_run_subset(pack, indices, len);
+    free(indices);
+    return result;
+}
+
+int toast_run_subset(PackOfToast pack, const size_t *indices, size_t len) {
+    SliceOfToast *all = pack.slices;
+    size_t size = pack.size;
+    pack.slices = malloc(sizeof(SliceOfToast)*(len + 1));
+    for (size_t k = 0; k < len; ++k) {
+        if (indices[k] >= size) {
+            fprintf(stderr, "[TOAST]["ESC"31mERROR"RES"] slice %ld is out of range, the pack holds %ld\n", indices[k], size);
+            exit(1);
+        }
+        pack.slices[k] = all[indices[k]];
+    }
+    pack.size = len;
+    pack.cap = len;
+    int result = bake_pack(pack);
+    for (size_t k = 0; k < len; ++k) {
+        all[indices[k]] = pack.slices[k];
+    }
+    free(pack.slices);
+    return result;
+}
+
+int toast_parallel(PackOfToast pack, size_t jobs) {
+    pack.jobs = jobs;
+    return toast(pack);
+}
+
+int toast_isolated(PackOfToast pack, size_t jobs) {
+    pack.jobs = jobs;
+    pack.isolate = 1;
+    return toast(pack);
+}
+
+//A test module loaded by toast_host
+typedef struct {
+    char *path;
+    void *handle;
+    void (*insert)(PackOfToast*);
+    int listed;
+} ToastModule;
+
+//Returns the module at [path], loading it if it isn't loaded yet, or NULL
+static ToastModule *load_module(ToastModule **modules, size_t *len, char *path, char *symbol) {
+    for (size_t m = 0; m < *len; ++m) {
+        if (strcmp((*modules)[m].path, path) == 0) {
+            return &(*modules)[m];
+        }
+    }
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        report_error(dlerror());
+        return NULL;
+    }
+    void (*insert)(PackOfToast*) = (void (*)(PackOfToast*))dlsym(handle, symbol);
+    if (insert == NULL) {
+        report_error(dlerror());
+        dlclose(handle);
+        return NULL;
+    }
+    *modules = realloc(*modules, sizeof(ToastModule)*(*len + 1));
+    (*modules)[*len] = (ToastModule){.path = strdup(path), .handle = handle, .insert = insert};
+    return &(*modules)[(*len)++];
+}
+
+//Unloads the modules that weren't listed for the last run
+static void unload_modules(ToastModule *modules, size_t *len) {
+    size_t kept = 0;
+    for (size_t m = 0; m < *len; ++m) {
+        if (modules[m].listed) {
+            modules[m].listed = 0;
+            modules[kept++] = modules[m];
+        } else {
+            dlclose(modules[m].handle);
+            free(modules[m].path);
+        }
+    }
+    *len = kept;
+}
+
+int toast_host(int cmd_fd, int status_fd) {
+    FILE *cmds = fdopen(cmd_fd, "r");
+    if (cmds == NULL) {
+        report_error(strerror(errno));
+        return 1;
+    }
+    ToastModule *modules = NULL;
+    size_t num_modules = 0;
+    //registration functions of the next run, in the order they were listed
+    void (**inserts)(PackOfToast*) = NULL;
+    size_t num_inserts = 0;
+    char **argv = malloc(sizeof(char*));
+    int argc = 1;
+    argv[0] = "toast";
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    while ((len = getline(&line, &cap, cmds)) > 0) {
+        if (line[len - 1] == '\n') {
+            line[--len] = '\0';
+        }
+        if (strncmp(line, "module ", 7) == 0) {
+            char *symbol = strrchr(line + 7, ' ');
+            if (symbol == NULL) {
+                continue;
+            }
+            *symbol++ = '\0';
+            ToastModule *module = load_module(&modules, &num_modules, line + 7, symbol);
+            if (module != NULL) {
+                module->listed = 1;
+                inserts = realloc(inserts, sizeof(*inserts)*(num_inserts + 1));
+                inserts[num_inserts++] = module->insert;
+            }
+        } else if (strncmp(line, "arg ", 4) == 0) {
+            argv = realloc(argv, sizeof(char*)*(argc + 1));
+            argv[argc++] = strdup(line + 4);
+        } else if (strcmp(line, "run") == 0) {
+            unload_modules(modules, &num_modules);
+            fflush(stdout);
+            fflush(stderr);
+            pid_t pid = fork();
+            if (pid == 0) {
+                PackOfToast pack = plug_in_toaster("Toaster");
+                for (size_t k = 0; k < num_inserts; ++k) {
+                    inserts[k](&pack);
+                }
+                turn_dials(&pack, argc, argv);
+                int regressed = toast(pack);
+                unplug_toaster(pack);
+                fflush(stdout);
+                _exit(regressed);
+            }
+            int status = 0;
+            if (pid < 0) {
+                report_error(strerror(errno));
+            } else {
+                waitpid(pid, &status, 0);
+            }
+            dprintf(status_fd, "done %d\n", status);
+            for (int a = 1; a < argc; ++a) {
+                free(argv[a]);
+            }
+            argc = 1;
+            num_inserts = 0;
+        }
+    }
+    for (size_t m = 0; m < num_modules; ++m) {
+        dlclose(modules[m].handle);
+        free(modules[m].path);
+    }
+    free(modules);
+    free(inserts);
+    free(argv);
+    free(line);
+    fclose(cmds);
+    return 0;
+}
+
+void burn_toast(BurntToast *burnt, char* diagnostic) {
+    burnt->yummy_or_burnt = BURNT;
+    burnt->diagnostic = diagnostic;
+    burnt->print_diagnostic = 1;
+}
+void eat_toast(BurntToast *burnt) {
+    burnt->yummy_or_burnt = YUMMY;
+}
+
+void *toast_fixture(BurntToast *burnt, const char *name) {
+    ToastFixture *fixture = NULL;
+    for (size_t f = 0; f < burnt->num_fixtures; ++f) {
+        ToastFixture *candidate = &burnt->fixtures[f];
+        if (strcmp(candidate->name, name) != 0) {
+            continue;
+        }
+        if (candidate->file == NULL) {
+            fixture = fixture == NULL ? candidate : fixture;
+        } else if (burnt->file != NULL && strcmp(candidate->file, burnt->file) == 0) {
+            fixture = candidate;
+            break;
+        }
+    }
+    if (fixture == NULL) {
+        burn_toast(burnt, "asked for a fixture that doesn't exist");
+        return NULL;
+    }
+    if (__atomic_load_n(&fixture->state, __ATOMIC_ACQUIRE) == RAW) {
+        //waiting for another worker to set it up doesn't count as test time either
+        uint64_t start = get_time_ns();
+        pthread_mutex_lock(&fixture->lock);
+        if (fixture->state == RAW) {
+            uint64_t setup_start = get_time_ns();
+            //the fixture outlives the slice, what it allocates isn't a leak
+            ToastAllocs *tracking = alloc_slice;
+            alloc_slice = NULL;
+            fixture->setup(fixture);
+            alloc_slice = tracking;
+            fixture->setup_ns += get_time_ns() - setup_start;
+            fixture->setups++;
+            __atomic_store_n(&fixture->state, fixture->value != NULL ? YUMMY : BURNT, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&fixture->lock);
+        burnt->setup_ns += get_time_ns() - start;
+    }
+    __atomic_fetch_add(&fixture->uses, 1, __ATOMIC_RELAXED);
+    if (fixture->state == BURNT) {
+        burn_toast(burnt, fixture->diagnostic != NULL ? (char*)fixture->diagnostic : "fixture setup failed");
+        return NULL;
+    }
+    return fixture->value;
+}
+
+void toast_alloc_budget(BurntToast *burnt, uint64_t allocs, uint64_t bytes) {
+    (void)burnt;
+    if (!ALLOCS_TRACKED || alloc_slice == NULL) {
+        static int warned = 0;
+        if (!__atomic_exchange_n(&warned, 1, __ATOMIC_RELAXED)) {
+            report_error("allocation budgets aren't checked, the suite is built without TOAST_TRACK_ALLOCS (toaster -A) or with a sanitizer");
+        }
+        return;
+    }
+    alloc_slice->budgeted = 1;
+    alloc_slice->budget_count = allocs;
+    alloc_slice->budget_bytes = bytes;
+    //settle_allocs turns these into what was spent since
+    alloc_slice->spent_count = alloc_slice->count;
+    alloc_slice->spent_bytes = alloc_slice->bytes;
 }
 
 void unplug_toaster(PackOfToast pack) {
+    for (size_t i = 0; i < pack.size; ++i) {
+        free(pack.slices[i].fuzz_stats.crash_path);
+        free(pack.slices[i].diagnostic_copy);
+    }
     free(pack.slices);
+    free(pack.only_files);
+    free(pack.filters);
+    free(pack.dep_files);
+    free(pack.dep_keys);
+    free(pack.fixtures);
+    close_reporter(pack.reporter);
 }
 
 
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <dirent.h>
 #include <stdlib.h>
@@ -6,6 +7,16 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/wait.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <stdint.h>
 #include <errno.h>
 #include <assert.h>
 
@@ -13,16 +24,19 @@
 #define DEFAULT_SRC_PATH "./tests"
 #define LOG_PREFIX  "[TOASTER]"
 #define DEFAULT_CAP 1024
-#define CC "gcc"
-#define GEN_FILE "tmp_toast.c"
-#define EXECUTABLE "tmp_toast"
+#define DEFAULT_CC "gcc"
+#define DEFAULT_PROFILE "debug"
 #define DEFIN_FILE "defin.test.c"
-#define LOGS "logs"
-#define NUM_GEN_FILES 3
-#define FILE_HEADER_LEN 108
-#define MAIN_DECL_LEN 64
-#define MAIN_CLOSE_LEN 55
-#define NUM_FLAGS 4
+#define TOAST_HEADER "toast.h"
+#define CAPTURE_CAP (64*1024) //compiler output kept per unit
+#define RELAY_CHUNK (64*1024)
+#define SUITE_GRACE_MS 5000
+#define HOST_STATUS_FD 3 //the persistent runner reports finished runs there
+#define DEFAULT_CACHE_DIR ".toast_cache"
+#define PATH_CAP 4096
+#define MEMO_FILE "results" //keys of passed cases, inside the cache dir
+#define HISTORY_FILE "history" //timings of every run, inside the cache dir
+#define ARENA_MIN_BLOCK 4096
 #define shift_arg(data, count) (assert((count) > 0), (count)--, *(data)++)
 
 #define append_one(ds, item)                            \
@@ -78,21 +92,92 @@
         printf("%s\n", tmp);                                  \
     } while (0)                                          \
 
+typedef enum {
+    FLAG_DIR,
+    FLAG_INCLUDE,
+    FLAG_EXCLUDE,
+    FLAG_JOBS,
+    FLAG_ISOLATE,
+    FLAG_TIMEOUT,
+    FLAG_SUITE_TIMEOUT,
+    FLAG_FILTER,
+    FLAG_SHARD,
+    FLAG_REPORTER,
+    FLAG_CACHE_DIR,
+    FLAG_PROFILE,
+    FLAG_CC,
+    FLAG_CFLAGS,
+    FLAG_LDFLAGS,
+    FLAG_LIBTOAST,
+    FLAG_ALLOCS,
+    FLAG_HISTORY,
+    FLAG_COMPARE,
+    FLAG_NO_CACHE,
+    FLAG_WATCH,
+    FLAG_STATS,
+    FLAG_KEEP,
+    FLAG_VERSION,
+    FLAG_HELP,
+    NUM_FLAGS
+} Flag;
+
 char* flags[NUM_FLAGS*2] = {
     "-d", "--dir", 
+    "-I", "--include", 
+    "-E", "--exclude", 
+    "-j", "--jobs", 
+    "-i", "--isolate", 
+    "-t", "--timeout", 
+    "-T", "--suite-timeout", 
+    "-f", "--filter", 
+    "-s", "--shard", 
+    "-r", "--reporter", 
+    "-c", "--cache-dir", 
+    "-p", "--profile", 
+    "-C", "--cc", 
+    "-F", "--cflags", 
+    "-L", "--ldflags", 
+    "-l", "--libtoast", 
+    "-A", "--allocs", 
+    "-H", "--history", 
+    "-R", "--compare", 
+    "-n", "--no-cache", 
+    "-w", "--watch", 
+    "-S", "--stats", 
     "-k", "--keep", 
     "-v", "--version", 
     "-h", "--help"};
 char* explanations[NUM_FLAGS] = {
-    "-d|--dir <dir>.......... specifies the src directory. [Default: '"DEFAULT_SRC_PATH"']",
-    "-k|--keep .............. toaster won't remove the files it generated",
+    "-d|--dir <dir>.......... specifies a src directory, searched recursively. Can be repeated [Default: '"DEFAULT_SRC_PATH"']",
+    "-I|--include <glob>..... only parse test files matching <glob> (path relative to the src directory or file name). Can be repeated",
+    "-E|--exclude <glob>..... skip files and directories matching <glob>. Can be repeated",
+    "-j|--jobs <n>........... run the test cases on <n> workers and compile on <n> processes, 0 uses every core [Default: 1]",
+    "-i|--isolate ........... run the test cases in forked workers, a crash only fails its own case",
+    "-t|--timeout <ms>....... burn a case once it ran for <ms>, runs the cases isolated",
+    "-T|--suite-timeout <ms>. burn every running case once the suite ran for <ms>, the test suite is killed 5s later",
+    "-f|--filter <pattern>... only run cases whose name or file matches the glob, or the regex if enclosed in '/'. Can be repeated",
+    "-s|--shard <i/N>........ only run the i-th of N shards, cases are assigned by a stable hash of file and name",
+    "-r|--reporter <kind>[:<path>] stream results as 'jsonl' or 'junit' to <path> ('-' is stdout) [Default: toast_report.jsonl|.xml]",
+    "-c|--cache-dir <dir>.... keeps compiled test suites there and reuses them while the sources are unchanged [Default: '"DEFAULT_CACHE_DIR"']",
+    "-p|--profile <name>..... build with the flags of 'debug', 'release', 'asan', 'tsan' or 'ubsan', each keeps its own objects [Default: '"DEFAULT_PROFILE"']",
+    "-C|--cc <compiler>...... compiler to build the test suite with [Default: '"DEFAULT_CC"']",
+    "-F|--cflags <flags>..... extra compiler flags, split at spaces, after those of the profile. Can be repeated",
+    "-L|--ldflags <flags>.... extra linker flags, split at spaces. Can be repeated",
+    "-l|--libtoast <path>.... link against a prebuilt libtoast.a or libtoast.so instead of compiling toast.h into the cache",
+    "-A|--allocs ............ track the heap allocations of every case, and check the budgets cases set",
+    "-H|--history <path>..... append the timings of every run there, tagged with the git revision, implies -n [Default: '<cache dir>/"HISTORY_FILE".<profile>']",
+    "-R|--compare <percent>.. fail if a case is an outlier of its last 10 runs in the history and more than <percent> slower than their median, implies -n",
+    "-n|--no-cache .......... run every case, even those that passed before and didn't change since",
+    "-w|--watch ............. stay around, rebuild and rerun the cases of test files as they change",
+    "-S|--stats ............. print the peak memory of toaster and how much the discovered cases take",
+    "-k|--keep .............. toaster won't remove the sources it generated from the cache",
     "-v|--version ........... print the current version of this toaster",
     "-h|--help .............. print this very text"
 };
 
 void usage(char* program, char* error) {
     printf("\nUsage:\n");
-    printf("%s [OPTIONS]\n\n", program);
+    printf("%s [OPTIONS] [-- RUNNER OPTIONS]\n\n", program);
     for (size_t i = 0; i < NUM_FLAGS; ++i) {
         printf("%s\n", explanations[i]);
     }
@@ -101,53 +186,246 @@ void usage(char* program, char* error) {
     } 
 }
 
+//NULL terminated argument list for exec, also used for lists of paths and
+//globs
+typedef struct {
+    char** items;
+    size_t len;
+    size_t cap;
+} Cmd;
+
 typedef struct {
     char* program;
-    char* dir;
+    Cmd dirs;
+    Cmd includes;
+    Cmd excludes;
+    char* jobs;
+    int isolate;
+    char* timeout;
+    char* suite_timeout;
+    Cmd filters;
+    char* shard;
+    char* reporter;
+    char* cache_dir;
+    char* profile;
+    char* cc;
+    Cmd cflags;
+    Cmd ldflags;
+    char* libtoast;
+    int allocs;
+    char* history;
+    char* compare;
+    int no_cache;
+    int watch;
+    int stats;
     int keep;
+    //everything after `--`, handed to the test binary as is
+    char** runner_args;
+    int runner_argc;
 } Args;
 
 Args args = {0};
 
+//Named sets of compiler flags, picked with -p|--profile
+typedef struct {
+    const char* name;
+    const char* cflags;
+    //the toast runtime is always optimized, sanitizers want it instrumented
+    //nevertheless
+    const char* runtime;
+} Profile;
+
+Profile profiles[] = {
+    {"debug",   "-O0 -g", ""},
+    {"release", "-O2 -march=native", "-march=native"},
+    {"asan",    "-O1 -g -fsanitize=address -fno-omit-frame-pointer", "-fsanitize=address"},
+    {"tsan",    "-O1 -g -fsanitize=thread", "-fsanitize=thread"},
+    {"ubsan",   "-O1 -g -fsanitize=undefined -fno-sanitize-recover=undefined", "-fsanitize=undefined"},
+};
+
+Profile* find_profile(const char* name) {
+    for (size_t i = 0; i < sizeof(profiles)/sizeof(profiles[0]); ++i) {
+        if (strcmp(profiles[i].name, name) == 0) {
+            return &profiles[i];
+        }
+    }
+    return NULL;
+}
+
+//Appends the space separated flags in [flags] to [cmd]
+void split_flags(Cmd *cmd, const char* flags) {
+    char* copy = strdup(flags);
+    for (char* flag = strtok(copy, " \t"); flag != NULL; flag = strtok(NULL, " \t")) {
+        append_one(cmd, flag);
+    }
+}
+
+char* expect_value(char* program, char* flag, char **argv, int argc) {
+    if (argc == 0) {
+        usage(program, "Expected argument for");
+        printf(" '%s'\n", flag);
+        exit(1);
+    }
+    return *argv;
+}
+
+char* expect_number(char* program, char* error, char* value) {
+    char *end = NULL;
+    strtoul(value, &end, 10);
+    if (value[0] == '-' || value[0] == '\0' || *end != '\0') {
+        usage(program, error);
+        printf(" '%s'\n", value);
+        exit(1);
+    }
+    return value;
+}
+
 void parse_args(int argc, char **argv) {
     char* program = shift_arg(argv, argc);
     args.program = program; 
-    args.dir = DEFAULT_SRC_PATH;
+    args.jobs = "1";
+    args.cache_dir = DEFAULT_CACHE_DIR;
+    args.profile = DEFAULT_PROFILE;
+    args.cc = DEFAULT_CC;
     args.keep = 0;
     int parsed;
     while (argc > 0) {
         char* arg = shift_arg(argv, argc);
+        if (strcmp(arg, "--") == 0) {
+            args.runner_args = argv;
+            args.runner_argc = argc;
+            break;
+        }
         parsed = 0;
         for (size_t i = 0; i < NUM_FLAGS*2; ++i) {
-            if (strcmp(arg, flags[i]) == 0) {
-                if (i < 2) {
-                    if (argc == 0) {
-                        usage(program, "Expected argument!\n");
+            if (strcmp(arg, flags[i]) != 0) {
+                continue;
+            }
+            parsed = 1;
+            switch ((Flag)(i/2)) {
+                case FLAG_DIR:
+                    expect_value(program, arg, argv, argc);
+                    append_one(&args.dirs, shift_arg(argv, argc));
+                    break;
+                case FLAG_INCLUDE:
+                    expect_value(program, arg, argv, argc);
+                    append_one(&args.includes, shift_arg(argv, argc));
+                    break;
+                case FLAG_EXCLUDE:
+                    expect_value(program, arg, argv, argc);
+                    append_one(&args.excludes, shift_arg(argv, argc));
+                    break;
+                case FLAG_JOBS:
+                    expect_value(program, arg, argv, argc);
+                    args.jobs = expect_number(program, "Expected a non-negative number of jobs, got", shift_arg(argv, argc));
+                    break;
+                case FLAG_TIMEOUT:
+                    expect_value(program, arg, argv, argc);
+                    args.timeout = expect_number(program, "Expected a timeout in ms, got", shift_arg(argv, argc));
+                    break;
+                case FLAG_SUITE_TIMEOUT:
+                    expect_value(program, arg, argv, argc);
+                    args.suite_timeout = expect_number(program, "Expected a timeout in ms, got", shift_arg(argv, argc));
+                    break;
+                case FLAG_ISOLATE:
+                    args.isolate = 1;
+                    break;
+                case FLAG_FILTER:
+                    expect_value(program, arg, argv, argc);
+                    append_one(&args.filters, shift_arg(argv, argc));
+                    break;
+                case FLAG_SHARD:
+                    {
+                        expect_value(program, arg, argv, argc);
+                        char *end = NULL;
+                        args.shard = shift_arg(argv, argc);
+                        unsigned long index = strtoul(args.shard, &end, 10);
+                        unsigned long count = *end == '/' ? strtoul(end + 1, &end, 10) : 0;
+                        if (*end != '\0' || index == 0 || index > count) {
+                            usage(program, "Expected a shard like i/N with 1 <= i <= N, got");
+                            printf(" '%s'\n", args.shard);
+                            exit(1);
+                        }
+                    }
+                    break;
+                case FLAG_REPORTER:
+                    expect_value(program, arg, argv, argc);
+                    args.reporter = shift_arg(argv, argc);
+                    //the kind is all up to the path
+                    size_t kind_len = strcspn(args.reporter, ":");
+                    if (kind_len != 5 || (strncmp(args.reporter, "jsonl", 5) != 0 && strncmp(args.reporter, "junit", 5) != 0)) {
+                        usage(program, "Expected a reporter of kind 'jsonl' or 'junit', got");
+                        printf(" '%s'\n", args.reporter);
                         exit(1);
-                    } else {
-                        args.dir = shift_arg(argv, argc);
-                        parsed = 1;
-                        break;
                     }
-                } else {
-                    size_t idx = i;
-                    if (idx % 2 != 0) {
-                        idx--;
+                    break;
+                case FLAG_CACHE_DIR:
+                    expect_value(program, arg, argv, argc);
+                    args.cache_dir = shift_arg(argv, argc);
+                    break;
+                case FLAG_PROFILE:
+                    expect_value(program, arg, argv, argc);
+                    args.profile = shift_arg(argv, argc);
+                    if (find_profile(args.profile) == NULL) {
+                        usage(program, "Expected a profile of 'debug', 'release', 'asan', 'tsan' or 'ubsan', got");
+                        printf(" '%s'\n", args.profile);
+                        exit(1);
                     }
-                    switch (idx) {
-                        case 2:
-                            args.keep = 1;
-                            parsed = 1;
-                            break;
-                        case 4:
-                            printf("%s v%s\n", program, VERSION);
-                            exit(0);
-                        case 6:
-                            usage(program, NULL);
-                            exit(0);
+                    break;
+                case FLAG_CC:
+                    expect_value(program, arg, argv, argc);
+                    args.cc = shift_arg(argv, argc);
+                    break;
+                case FLAG_CFLAGS:
+                    expect_value(program, arg, argv, argc);
+                    split_flags(&args.cflags, shift_arg(argv, argc));
+                    break;
+                case FLAG_LDFLAGS:
+                    expect_value(program, arg, argv, argc);
+                    split_flags(&args.ldflags, shift_arg(argv, argc));
+                    break;
+                case FLAG_LIBTOAST:
+                    expect_value(program, arg, argv, argc);
+                    args.libtoast = shift_arg(argv, argc);
+                    if (access(args.libtoast, R_OK) != 0) {
+                        usage(program, "Can't read libtoast");
+                        printf(" '%s'\n", args.libtoast);
+                        exit(1);
                     }
-                }
-            } 
+                    break;
+                case FLAG_ALLOCS:
+                    args.allocs = 1;
+                    break;
+                case FLAG_HISTORY:
+                    expect_value(program, arg, argv, argc);
+                    args.history = shift_arg(argv, argc);
+                    break;
+                case FLAG_COMPARE:
+                    expect_value(program, arg, argv, argc);
+                    args.compare = expect_number(program, "Expected a slowdown in percent, got", shift_arg(argv, argc));
+                    break;
+                case FLAG_NO_CACHE:
+                    args.no_cache = 1;
+                    break;
+                case FLAG_WATCH:
+                    args.watch = 1;
+                    break;
+                case FLAG_STATS:
+                    args.stats = 1;
+                    break;
+                case FLAG_KEEP:
+                    args.keep = 1;
+                    break;
+                case FLAG_VERSION:
+                    printf("%s v%s\n", program, VERSION);
+                    exit(0);
+                case FLAG_HELP:
+                    usage(program, NULL);
+                    exit(0);
+                default:
+                    break;
+            }
+            break;
         }
         if (parsed == 0) {
             usage(program, "Unknown flag");
@@ -155,26 +433,154 @@ void parse_args(int argc, char **argv) {
             exit(1);
         }
     }
+    //allocations are tracked by the runtime, a prebuilt one tracks them if
+    //it was built to, -A would only pretend to
+    if (args.allocs && args.libtoast != NULL) {
+        usage(program, "-A doesn't track allocations with a prebuilt libtoast, build it with -DTOAST_TRACK_ALLOCS and drop");
+        printf(" '-A'\n");
+        exit(1);
+    }
+    if (args.dirs.len == 0) {
+        append_one(&args.dirs, DEFAULT_SRC_PATH);
+    }
 }
 
-const char file_header[FILE_HEADER_LEN] = "/*\nThis is an auto-generated file. Produced by toaster.\n*/\n#define TOAST_IMPLEMENTATION\n#include \"toast.h\"\n\n";
-const char main_decl[MAIN_DECL_LEN] = "int main() {\n  PackOfToast pack = plug_in_toaster(\"Toaster\");\n\n";
-const char main_close[MAIN_CLOSE_LEN] = "\n  toast(pack);\n  unplug_toaster(pack);\n  return 0;\n}\n";
+const char unit_header[] = "/*\nThis is an auto-generated file. Produced by toaster.\n*/\n#include \"toast.h\"\n\n";
+const char main_header[] = "/*\nThis is an auto-generated file. Produced by toaster.\n*/\n#include \"toast.h\"\n\n";
+const char main_decl[] = "int main(int argc, char **argv) {\n  PackOfToast pack = plug_in_toaster(\"Toaster\");\n  turn_dials(&pack, argc, argv);\n\n";
+const char main_close[] = "  insert_linked_toasts(&pack);\n\n  int regressed = toast(pack);\n  unplug_toaster(pack);\n  return regressed;\n}\n";
+//main() of the persistent runner --watch loads the test files into
+const char host_source[] = "/*\nThis is an auto-generated file. Produced by toaster.\n*/\n#include \"toast.h\"\n\nint main(void) {\n  return toast_host(STDIN_FILENO, 3);\n}\n";
+
+//flags the test suite is compiled with, part of the build cache key, and the
+//flags the toast runtime is compiled with, once per version of toast.h. Both
+//depend on the profile, see set_toolchain.
+const char **cflags = NULL;
+const char **runtime_flags = NULL;
+//linker flags of the test suite and of the persistent runner, which links
+//in toast, test modules take it from there
+const char **ldflags = NULL;
+const char **host_ldflags = NULL;
+//profile, compiler and flags, handed to the test suite for its header
+char build_info[DEFAULT_CAP];
+
+void append_flags(Cmd *cmd, const char **flags) {
+    for (size_t i = 0; flags[i] != NULL; ++i) {
+        append_one(cmd, (char*)flags[i]);
+    }
+}
+
+//Puts together the flags of the chosen profile and those passed on the
+//command line. Objects are cached by a hash of their flags, so every profile
+//keeps its own.
+void set_toolchain() {
+    Profile *profile = find_profile(args.profile);
+    const char *base[] = {"-fPIC", "-pthread", "-I.", NULL};
+    const char *runtime_base[] = {"-O2", "-pthread", NULL};
+    const char *runtime_tail[] = {"-DTOAST_IMPLEMENTATION", "-x", "c", NULL};
+    const char *dl[] = {"-rdynamic", "-ldl", NULL};
+    Cmd compile = {0}, runtime = {0}, link = {0}, host = {0};
+
+    split_flags(&compile, profile->cflags);
+    append_flags(&compile, base);
+    append_many(&compile, args.cflags.items, args.cflags.len);
+    //budgets only burn with tracking, so it is part of the memo keys as well
+    if (args.allocs) {
+        append_one(&compile, (char*)"-DTOAST_TRACK_ALLOCS");
+    }
+    append_one(&compile, NULL);
+
+    append_flags(&runtime, runtime_base);
+    split_flags(&runtime, profile->runtime);
+    append_many(&runtime, args.cflags.items, args.cflags.len);
+    if (args.allocs) {
+        append_one(&runtime, (char*)"-DTOAST_TRACK_ALLOCS");
+    }
+    append_flags(&runtime, runtime_tail);
+    append_one(&runtime, NULL);
+
+    append_many(&link, args.ldflags.items, args.ldflags.len);
+    append_one(&link, NULL);
+    append_flags(&host, dl);
+    append_many(&host, args.ldflags.items, args.ldflags.len);
+    append_one(&host, NULL);
+
+    cflags = (const char**)compile.items;
+    runtime_flags = (const char**)runtime.items;
+    ldflags = (const char**)link.items;
+    host_ldflags = (const char**)host.items;
+
+    int n = snprintf(build_info, sizeof(build_info), "%s: %s", profile->name, args.cc);
+    for (size_t i = 0; cflags[i] != NULL && n < (int)sizeof(build_info); ++i) {
+        n += snprintf(build_info + n, sizeof(build_info) - n, " %s", cflags[i]);
+    }
+    for (size_t i = 0; ldflags[i] != NULL && n < (int)sizeof(build_info); ++i) {
+        n += snprintf(build_info + n, sizeof(build_info) - n, " %s", ldflags[i]);
+    }
+}
 
-const char *gen_files[NUM_GEN_FILES] = {GEN_FILE, LOGS, EXECUTABLE};
+typedef enum {
+    CASE_TOAST, // void name(BurntToast*)
+    CASE_BENCH, // void name(BurntToast*, uint64_t iters)
+    CASE_FUZZ, // void name(BurntToast*, const uint8_t *data, size_t len)
+    CASE_SETUP, // void [suite_]setup_<fixture>(ToastFixture*)
+    CASE_TEARDOWN, // void [suite_]teardown_<fixture>(ToastFixture*)
+    CASE_HELPER, // takes a ToastFixture*, but isn't named like a hook
+    CASE_FILE, // the whole file, it registers its cases with TOAST()
+} CaseKind;
 
 typedef struct {
     char* file_name;
     size_t s; //function name start
     size_t l; //function name len
     char* function;
+    size_t len; //function len
+    CaseKind kind;
 } Case;
 
-char* case_get_fn_name(Case *item) {
-    char* name = malloc(item->l+1);
-    memcpy(name, item->function+item->s, item->l);
-    name[item->l] = '\0';
-    return name;
+#define SUITE_PREFIX "suite_"
+
+//Returns the fixture name of a setup or teardown hook, and whether the
+//fixture is shared with the suite instead of only its file
+const char *fixture_name(Case *item, size_t *len, int *suite) {
+    const char *name = item->function + item->s;
+    size_t l = item->l;
+    *suite = l > sizeof(SUITE_PREFIX)-1 && strncmp(name, SUITE_PREFIX, sizeof(SUITE_PREFIX)-1) == 0;
+    if (*suite) {
+        name += sizeof(SUITE_PREFIX)-1;
+        l -= sizeof(SUITE_PREFIX)-1;
+    }
+    size_t skip = item->kind == CASE_SETUP ? 6 : 9; // "setup_" or "teardown_"
+    *len = l - skip;
+    return name + skip;
+}
+
+//Tells test cases, benchmarks, fuzz targets and fixture hooks apart by their
+//parameter list
+CaseKind classify_case(Case *item) {
+    char* params = item->function + item->s + item->l;
+    char* close = strchr(params, ')');
+    size_t len = close != NULL ? (size_t)(close - params) : strlen(params);
+    if (memmem(params, len, "ToastFixture", 12) != NULL) {
+        const char *name = item->function + item->s;
+        size_t l = item->l;
+        if (l > sizeof(SUITE_PREFIX)-1 && strncmp(name, SUITE_PREFIX, sizeof(SUITE_PREFIX)-1) == 0) {
+            name += sizeof(SUITE_PREFIX)-1;
+            l -= sizeof(SUITE_PREFIX)-1;
+        }
+        if (l > 6 && strncmp(name, "setup_", 6) == 0) {
+            return CASE_SETUP;
+        }
+        if (l > 9 && strncmp(name, "teardown_", 9) == 0) {
+            return CASE_TEARDOWN;
+        }
+        return CASE_HELPER;
+    }
+    if (memmem(params, len, "uint8_t", 7) != NULL) {
+        return CASE_FUZZ;
+    }
+    char* bench_param = memmem(params, len, "uint64_t", 8);
+    return bench_param != NULL ? CASE_BENCH : CASE_TOAST;
 }
 
 typedef struct {
@@ -192,6 +598,61 @@ typedef struct {
 void free_cases(Cases cases) {
     free(cases.items);
 }
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t len;
+    size_t cap;
+    char data[];
+} ArenaBlock;
+
+//Bump allocator holding the path and cases of a test file, so they are freed
+//in one go. Callers allocate what they need at once, a block is only bigger
+//than ARENA_MIN_BLOCK to fit a single allocation.
+typedef struct {
+    ArenaBlock *head;
+    size_t used;
+    size_t reserved;
+    size_t blocks;
+} Arena;
+
+void *arena_alloc(Arena *arena, size_t size) {
+    size = (size + 7) & ~(size_t)7;
+    ArenaBlock *block = arena->head;
+    if (block == NULL || block->cap - block->len < size) {
+        size_t cap = size > ARENA_MIN_BLOCK ? size : ARENA_MIN_BLOCK;
+        block = malloc(sizeof(ArenaBlock) + cap);
+        if (block == NULL) {
+            fprintf(stderr, LOG_PREFIX"[ERROR] could not allocate\n");
+            exit(1);
+        }
+        *block = (ArenaBlock){.next = arena->head, .cap = cap};
+        arena->head = block;
+        arena->reserved += cap;
+        arena->blocks++;
+    }
+    void *ptr = block->data + block->len;
+    block->len += size;
+    arena->used += size;
+    return ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *str, size_t len) {
+    char *copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+void arena_free(Arena *arena) {
+    ArenaBlock *block = arena->head;
+    while (block != NULL) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    *arena = (Arena){0};
+}
 void str_clear(Str *s) {
     s->len = 0;
 }
@@ -230,36 +691,9 @@ void str_free(Str s) {
     free(s.items);
 }
 
-typedef enum {
-    Void,
-    CurlyOpen,
-    CurlyClose,
-    FnName
-} Token;
-
-static const char v[4] = {'v','o','i', 'd'};
-char v_tmp[4] = {'v'};
-
-void three(FILE *file) {
-    size_t i = 1;
-    while ((v_tmp[i] = (char)getc(file)) != EOF) {
-        i++;
-        if (i==4) {
-            break;
-        }
-    }
-}
-
-typedef enum {
-    VOID,
-    START_FN_NAME,
-    COUNT_FN_NAME,
-    END
-} FileParserState;
-
-char* read_defin(char* file_path) {
-    char full_path[strlen(args.dir) + strlen(file_path)+2];
-    sprintf(full_path, "%s/%s", args.dir, file_path);
+char* read_defin(char* dir, char* file_path) {
+    char full_path[strlen(dir) + strlen(file_path)+2];
+    sprintf(full_path, "%s/%s", dir, file_path);
     printf(LOG_PREFIX" reading %s\n", full_path);
     FILE *file = fopen(full_path, "r");
     if (file == NULL) {
@@ -279,8 +713,9 @@ char* read_defin(char* file_path) {
         exit(1);
     }
     rewind(file);
-    char* buf = malloc(len);
-    if (fread(buf, len, 1, file) != 1) {
+    char* buf = malloc(len + 1);
+    buf[len] = '\0';
+    if (len > 0 && fread(buf, len, 1, file) != 1) {
         fprintf(stderr, LOG_PREFIX"[ERROR] could not read '%s'\n", file_path);
         exit(1);
     }
@@ -288,126 +723,348 @@ char* read_defin(char* file_path) {
     return buf;
 }
 
-Case parse_case(FILE *file, char* file_name, int *done) {
-    
-    char ch;
-    Str buf = {0};
-    FileParserState state = VOID;
-    size_t fn_name_start = 0;
-    size_t fn_name_len = 0;
-    size_t braces_count = 0;
-    int run = 1;
-    while (run > 0) {
-        
-        ch = (char)getc(file);
-        if (ch == EOF) {
-            *done = 1;
-            run = 0;
-            break;
+//Appends the defin.test.c of another source directory
+void append_defines(char** defines, char* more) {
+    if (*defines == NULL) {
+        *defines = more;
+        return;
+    }
+    size_t len = strlen(*defines);
+    *defines = realloc(*defines, len + strlen(more) + 2);
+    (*defines)[len] = '\n';
+    strcpy(*defines + len + 1, more);
+    free(more);
+}
+
+#define ONES  0x0101010101010101ULL
+#define HIGHS 0x8080808080808080ULL
+
+//Non-zero if any byte of [word] equals the byte repeated in [pattern]. Only 
+//the lowest flagged byte is exact, borrows can flag bytes above it.
+static inline uint64_t has_byte(uint64_t word, uint64_t pattern) {
+    uint64_t x = word ^ pattern;
+    return (x - ONES) & ~x & HIGHS;
+}
+
+//Finds the next '{' or '}' in [p, end), eight bytes at a time
+const char* find_brace(const char *p, const char *end) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    while (end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        uint64_t hits = has_byte(word, ONES*'{') | has_byte(word, ONES*'}');
+        if (hits != 0) {
+            return p + (__builtin_ctzll(hits) >> 3);
         }
-        switch (state) {
-            case VOID:
-                {
-                    if (ch == 'v') {
-                        v_tmp[0] = 'v';
-                        three(file);
-                        if (memcmp(v_tmp, v, 4) == 0) {
-                            append_many(&buf, v_tmp, 4);
-                            state = START_FN_NAME;
-                            break;
-                        }
-                    }
-                }
-                break;
-            case START_FN_NAME:
-                {
-                    append_one(&buf, ch);
-                    if (ch == ' ' || ch == '\n') {
-                        break; 
-                    } else {
-                        fn_name_start = buf.len-1; 
-                        state = COUNT_FN_NAME;
-                        break;
-                    }
-                }
-             case COUNT_FN_NAME:
-                {
-                    append_one(&buf, ch);
-                    if (ch == '(') {
-                        fn_name_len = (buf.len -1) - fn_name_start;
-                        state = END;
-                        break;
-                    } 
-                }
+        p += 8;
+    }
+#endif
+    for (; p < end; ++p) {
+        if (*p == '{' || *p == '}') {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static inline bool is_ident(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') 
+        || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+static inline bool is_space(char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+}
+
+//Skips the comment, string or character literal starting at [p], returns
+//[p] if none starts there
+static const char* skip_literal(const char *p, const char *end) {
+    if (end - p >= 2 && p[0] == '/' && p[1] == '/') {
+        const char *newline = memchr(p, '\n', end - p);
+        return newline != NULL ? newline : end;
+    }
+    if (end - p >= 2 && p[0] == '/' && p[1] == '*') {
+        const char *close = memmem(p + 2, end - p - 2, "*/", 2);
+        return close != NULL ? close + 2 : end;
+    }
+    if (*p == '"' || *p == '\'') {
+        char quote = *p;
+        for (p++; p < end && *p != quote && *p != '\n'; ++p) {
+            if (*p == '\\' && p + 1 < end) {
+                p++;
+            }
+        }
+        //an unterminated literal ends with its line
+        return p < end && *p == quote ? p + 1 : p;
+    }
+    return p;
+}
+
+//Finds the next comment or literal starting in [p, end), eight bytes at a
+//time
+static const char* find_literal(const char *p, const char *end) {
+    while (p < end) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        while (end - p >= 8) {
+            uint64_t word;
+            memcpy(&word, p, 8);
+            uint64_t hits = has_byte(word, ONES*'/') | has_byte(word, ONES*'"') | has_byte(word, ONES*'\'');
+            if (hits != 0) {
+                p += __builtin_ctzll(hits) >> 3;
                 break;
-             case END:
-                {
-                    append_one(&buf, ch);
-                    if (ch == '{') {
-                        braces_count++;
-                    }
-                    if (ch == '}') {
-                        braces_count--;
-                        if (braces_count == 0) {
-                            run = 0;
-                        }
-                    }
-                }
+            }
+            p += 8;
+        }
+#endif
+        for (; p < end; ++p) {
+            if (*p == '/' || *p == '"' || *p == '\'') {
                 break;
-            default:
-                continue;
+            }
+        }
+        if (p < end && skip_literal(p, end) != p) {
+            return p;
         }
+        //a division
+        p++;
     }
-    if (run == 0) {
-        append_one(&buf, '\0');
-        Case item = {
+    return NULL;
+}
+
+//Finds the next [needle] in [p, end) that is code, not part of a comment
+//or a literal
+static const char* find_code(const char *p, const char *end, const char *needle, size_t len) {
+    while (p < end) {
+        const char *hit = memmem(p, end - p, needle, len);
+        if (hit == NULL) {
+            return NULL;
+        }
+        const char *literal = find_literal(p, hit);
+        if (literal == NULL) {
+            return hit;
+        }
+        p = skip_literal(literal, end);
+    }
+    return NULL;
+}
+
+//Finds the next '{' or '}' in [p, end) that is code
+static const char* find_code_brace(const char *p, const char *end) {
+    while (p < end) {
+        const char *hit = find_brace(p, end);
+        if (hit == NULL) {
+            return NULL;
+        }
+        const char *literal = find_literal(p, hit);
+        if (literal == NULL) {
+            return hit;
+        }
+        p = skip_literal(literal, end);
+    }
+    return NULL;
+}
+
+//Finds the next `void name(...) {...}` in [p, end), [start] being the start
+//of the file. Returns the end of the function or NULL if there is none, 
+//[item] is filled with its text.
+const char* scan_case(const char *start, const char *p, const char *end, char* file_name, Case *item) {
+    while (p < end) {
+        const char *v = find_code(p, end, "void", 4);
+        if (v == NULL) {
+            return NULL;
+        }
+        p = v + 4;
+        //"avoid" or "voidp" are not a `void`
+        if ((v > start && is_ident(v[-1])) || (p < end && is_ident(*p))) {
+            continue;
+        }
+        const char *name = p;
+        while (name < end && is_space(*name)) {
+            name++;
+        }
+        if (name == p || name >= end || !is_ident(*name)) {
+            continue;
+        }
+        const char *name_end = name;
+        while (name_end < end && is_ident(*name_end)) {
+            name_end++;
+        }
+        const char *paren = name_end;
+        while (paren < end && is_space(*paren)) {
+            paren++;
+        }
+        if (paren >= end || *paren != '(') {
+            continue;
+        }
+        const char *body = find_code_brace(paren, end);
+        if (body == NULL || *body == '}') {
+            fprintf(stderr, LOG_PREFIX"[ERROR] parsing test case in '%s', unbalanced braces\n", file_name);
+            exit(1);
+        }
+        //just a declaration
+        const char *semicolon = memchr(paren, ';', body - paren);
+        if (semicolon != NULL) {
+            p = semicolon + 1;
+            continue;
+        }
+
+        size_t braces_count = 1;
+        const char *brace = body + 1;
+        while (braces_count > 0 && (brace = find_code_brace(brace, end)) != NULL) {
+            braces_count += *brace == '{' ? 1 : -1;
+            brace++;
+        }
+        if (brace == NULL) {
+            fprintf(stderr, LOG_PREFIX"[ERROR] parsing test case in '%s', unbalanced braces\n", file_name);
+            exit(1);
+        }
+        size_t len = brace - v;
+        *item = (Case){
             .file_name = file_name,
-            .s = fn_name_start,
-            .l = fn_name_len,
-            .function = malloc(buf.len),
+            .s = name - v,
+            .l = name_end - name,
+            .function = (char*)v,
+            .len = len,
         };
-        memcpy(item.function, buf.items, buf.len);
-        str_free(buf);
-        return item;
-    } else {
-        fprintf(stderr, LOG_PREFIX"[ERROR] parsing test case\n");
-        exit(1);
+        item->kind = classify_case(item);
+        return brace;
     }
+    return NULL;
 }
 
+//Whether a test file defines its cases with TOAST(), TOAST_BENCH(),
+//TOAST_FUZZ(), TOAST_PARAMS() or TOAST_PARAMS_FILE(), it is compiled as it
+//is then. Mentions in comments and literals don't count.
+bool uses_toast_macros(const char *start, const char *end) {
+    const char *suffixes[] = {"_BENCH", "_FUZZ", "_PARAMS_FILE", "_PARAMS"};
+    const char *p = start;
+    while ((p = find_code(p, end, "TOAST", 5)) != NULL) {
+        const char *q = p + 5;
+        for (size_t i = 0; i < sizeof(suffixes)/sizeof(suffixes[0]); ++i) {
+            size_t len = strlen(suffixes[i]);
+            if ((size_t)(end - q) >= len && memcmp(q, suffixes[i], len) == 0) {
+                q += len;
+                break;
+            }
+        }
+        bool word = p == start || !is_ident(p[-1]);
+        p += 5;
+        while (q < end && is_space(*q)) {
+            q++;
+        }
+        if (word && q < end && *q == '(') {
+            return true;
+        }
+    }
+    return false;
+}
 
-int parse_file(Cases *cases, char* dir_name, char* file_name) {
-    char* file_path = malloc(strlen(dir_name) + strlen(file_name) + 2); //delimiter + terminator
-    strcpy(file_path, dir_name);
-    strcat(file_path, "/");
-    strcat(file_path, file_name), 
+//Whether [item], found in a file using the macros, looks like a plain
+//`void name(BurntToast*)` case. Static functions are taken for helpers.
+bool is_plain_case(const char *start, const Case *item) {
+    if (item->kind != CASE_TOAST && item->kind != CASE_BENCH && item->kind != CASE_FUZZ) {
+        return false;
+    }
+    const char *params = item->function + item->s + item->l;
+    const char *close = memchr(params, ')', item->len - item->s - item->l);
+    if (close == NULL || memmem(params, close - params, "BurntToast", 10) == NULL) {
+        return false;
+    }
+    const char *line = item->function;
+    while (line > start && line[-1] != '\n') {
+        line--;
+    }
+    return memmem(line, item->function - line, "static", 6) == NULL;
+}
 
+//Maps a test file and appends every case in it. Their functions are copied
+//into [arena] in one go and share [file_path] as file name. Adds the size of the file
+//to [bytes], so discovery throughput can be reported.
+int parse_file(Cases *cases, Arena *arena, char* file_path, size_t *bytes) {
     printf(LOG_PREFIX" parsing %s\n", file_path);
 
-    FILE *file = fopen(file_path, "r");
-    if (file == NULL) {
+    int fd = open(file_path, O_RDONLY);
+    if (fd < 0) {
         fprintf(stderr, LOG_PREFIX"[ERROR] could not open file '%s' because: %s\n", file_path, strerror(errno));
         return 1;
     }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] could not stat file '%s' because: %s\n", file_path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] could not map file '%s' because: %s\n", file_path, strerror(errno));
+        return 1;
+    }
+    madvise((void*)data, st.st_size, MADV_SEQUENTIAL);
 
-
-    size_t file_name_len = strlen(file_name) + 1;
-    int done = 0;
-
-    while (1) {
-        char *current_filename = malloc(file_name_len);
-        memcpy(current_filename, file_name, file_name_len);
-        Case item = parse_case(file, current_filename, &done);
-        if (done == 1) {
-            break;
+    const char *end = data + st.st_size;
+    if (uses_toast_macros(data, end)) {
+        //the file is compiled as it is, plain cases in it would never run
+        const char *p = data;
+        Case item;
+        while ((p = scan_case(data, p, end, file_path, &item)) != NULL) {
+            if (is_plain_case(data, &item)) {
+                fprintf(stderr, LOG_PREFIX"[ERROR] '%s' defines cases with TOAST() and '%.*s' as a plain function, "
+                        "define it with TOAST() too\n", file_path, (int)item.l, item.function + item.s);
+                exit(1);
+            }
         }
+        append_one(cases, ((Case){.file_name = file_path, .function = "", .kind = CASE_FILE}));
+        munmap((void*)data, st.st_size);
+        *bytes += st.st_size;
+        return 0;
+    }
+    const char *p = data;
+    Case item;
+    size_t first = cases->len;
+    size_t text = 0;
+    while ((p = scan_case(data, p, end, file_path, &item)) != NULL) {
         append_one(cases, item);
+        text += item.len + 1;
     }
-    fclose(file);
+    //the functions still point into the mapping
+    char *copy = arena_alloc(arena, text);
+    for (size_t i = first; i < cases->len; ++i) {
+        Case *c = &cases->items[i];
+        memcpy(copy, c->function, c->len);
+        copy[c->len] = '\0';
+        c->function = copy;
+        copy += c->len + 1;
+    }
+    munmap((void*)data, st.st_size);
+    *bytes += st.st_size;
     return 0;
 }
 
 
+uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+void print_discovery(size_t num_cases, size_t files, size_t bytes, uint64_t ns) {
+    double secs = ns > 0 ? ns/1e9 : 1e-9;
+    printf(LOG_PREFIX" discovered %ld cases in %ld files (%ld bytes) in %.3fms, %.1f MB/s\n", 
+            num_cases, files, bytes, ns/1e6, bytes/secs/1e6);
+}
+
+size_t num_jobs() {
+    size_t jobs = strtoul(args.jobs, NULL, 10);
+    if (jobs == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = online > 0 ? (size_t)online : 1;
+    }
+    return jobs;
+}
 
 bool is_test_file(char *file_name) {
     char ch;
@@ -444,175 +1101,1745 @@ bool is_test_file(char *file_name) {
     return false;
 }
 
-int write_test_file(Cases *cases, FILE *file, char* defines) {
-    Str data = {0};
-    
-    append_many(&data, file_header, FILE_HEADER_LEN);
-    if (defines[0] != '\0') {
-        append_many(&data, defines, strlen(defines));
-        append_one(&data, '\n');
-        free(defines);
-    }
-    for (size_t i = 0; i < cases->len; ++i) {
-        append_many(&data, cases->items[i].function, strlen(cases->items[i].function));
-    }
-    
-    append_many(&data, main_decl, MAIN_DECL_LEN-1);
-    
-    char identifier[128];
-    for (size_t i = 0; i < cases->len; ++i) {
-        append_many(&data, "  SliceOfToast ", 15);
-        sprintf(identifier, "slice_%ld", i);
-        append_many(&data, identifier, strlen(identifier));
-        char* fn_name = case_get_fn_name(&cases->items[i]);
-        append_many(&data, " = {.toast = ", 13);
-        append_many(&data, 
-                fn_name, 
-                cases->items[i].l);
-        append_many(&data, ", .name = \"", 11);
-        append_many(&data, 
-                fn_name, 
-                cases->items[i].l);
-        append_many(&data, "\"};\n  insert_toast(&pack, ", 26);
-        append_many(&data, identifier, strlen(identifier));
-        append_many(&data, ");\n\n", 4);
+//A test file found while walking the source directories, parsed by one of
+//the scan workers
+typedef struct {
+    char* path;
+    size_t root; //index of the source directory it was found in
+    //holds [path] and the functions of [cases]
+    Arena arena;
+    Cases cases;
+    size_t bytes;
+    int failed;
+} ScanJob;
+
+//Queue between the directory walker and the scan workers. The walker keeps
+//appending while the workers parse what was found so far.
+typedef struct {
+    ScanJob** items;
+    size_t len;
+    size_t cap;
+    size_t next;
+    int walking;
+    pthread_mutex_t lock;
+    pthread_cond_t found;
+} ScanQueue;
+
+void *scan_worker(void *arg) {
+    ScanQueue *queue = arg;
+    //cases are parsed in here, and copied into the file's arena at their size
+    Cases scratch = {0};
+    while (1) {
+        pthread_mutex_lock(&queue->lock);
+        while (queue->next >= queue->len && queue->walking) {
+            pthread_cond_wait(&queue->found, &queue->lock);
+        }
+        if (queue->next >= queue->len) {
+            pthread_mutex_unlock(&queue->lock);
+            break;
+        }
+        ScanJob *job = queue->items[queue->next++];
+        pthread_mutex_unlock(&queue->lock);
+        scratch.len = 0;
+        job->failed = parse_file(&scratch, &job->arena, job->path, &job->bytes);
+        job->cases = (Cases){
+            .items = arena_alloc(&job->arena, sizeof(Case)*scratch.len),
+            .len = scratch.len,
+            .cap = scratch.len,
+        };
+        if (scratch.len > 0) {
+            memcpy(job->cases.items, scratch.items, sizeof(Case)*scratch.len);
+        }
     }
+    free(scratch.items);
+    return NULL;
+}
 
-    append_many(&data, main_close, MAIN_CLOSE_LEN-1);
+void push_scan_job(ScanQueue *queue, const char* path, size_t root) {
+    ScanJob *job = calloc(1, sizeof(ScanJob));
+    job->path = arena_strndup(&job->arena, path, strlen(path));
+    job->root = root;
+    pthread_mutex_lock(&queue->lock);
+    append_one(queue, job);
+    pthread_cond_signal(&queue->found);
+    pthread_mutex_unlock(&queue->lock);
+}
 
-   if (fwrite(data.items, 1, data.len, file) < data.len) {
-        fprintf(stderr, LOG_PREFIX"[ERROR] writing to tmp_toast.c failed\n");
-        return 1;
-   };
-    str_free(data);
-    return 0;
+typedef struct {
+    ScanJob** items;
+    size_t len;
+    size_t cap;
+} ScanJobs;
+
+void free_scan_job(ScanJob *job) {
+    arena_free(&job->arena);
+    free(job);
 }
 
-int remove_generated_files(int skip_bin) {
-    int success = 0;
-    for (int i = 0; i < NUM_GEN_FILES-skip_bin; ++i) {
-           if (remove(gen_files[i]) < 0) {
-               fprintf(stderr, LOG_PREFIX"[ERROR] deleting '%s' file (%s)\n", gen_files[i], strerror(errno));
-            } else {
-                success++;
-            }
+//Peak memory of toaster and its children, and what the discovered files hold
+void print_memory(ScanJobs *files) {
+    size_t used = 0, reserved = 0, blocks = 0, num_cases = 0;
+    for (size_t i = 0; i < files->len; ++i) {
+        used += files->items[i]->arena.used;
+        reserved += files->items[i]->arena.reserved;
+        blocks += files->items[i]->arena.blocks;
+        num_cases += files->items[i]->cases.len;
     }
-   if (success == NUM_GEN_FILES-skip_bin) {
-       printf(LOG_PREFIX" clean-up of generated files successful\n");
-       return 0;
-   } else {
-       printf(LOG_PREFIX" clean-up of generated files (partially) failed. %d/%d were deleted\n", success, NUM_GEN_FILES-skip_bin);
-       return 1;
-   }
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    printf(LOG_PREFIX" peak RSS %ld KiB (largest child %ld KiB), %ld cases of %ld files take %ld bytes in %ld arena blocks of %ld bytes\n",
+            self.ru_maxrss, children.ru_maxrss, num_cases, files->len, used, blocks, reserved);
 }
 
+//Matches a glob against the path relative to its source directory and 
+//against the file name alone, so "*.test.c" and "net/*" both work
+bool matches_any(Cmd *globs, const char *rel_path, const char *name) {
+    for (size_t i = 0; i < globs->len; ++i) {
+        if (fnmatch(globs->items[i], rel_path, 0) == 0 || fnmatch(globs->items[i], name, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
 
-int main(int argc, char **argv) {
-    parse_args(argc, argv);
-    struct dirent *de;
-    printf(LOG_PREFIX" Reading dir '%s'.\n", args.dir);
+//Whether a file is a test file that passes the include/exclude globs
+bool wants_file(const char *rel_path, const char *name) {
+    return is_test_file((char*)name)
+        && strcmp(name, DEFIN_FILE) != 0
+        && (args.includes.len == 0 || matches_any(&args.includes, rel_path, name))
+        && !matches_any(&args.excludes, rel_path, name);
+}
 
-    DIR *source_dir = opendir(args.dir);
-    if (source_dir == NULL) {
-        printf(LOG_PREFIX"[ERROR] Source directory %s was not found\n", args.dir);
-        exit(1);
+//Walks [dir_fd] recursively, queueing every test file that passes the
+//include/exclude globs. Takes ownership of [dir_fd].
+void walk_dir(ScanQueue *queue, int dir_fd, const char* path, const char *rel_path, size_t root, char** defines) {
+    DIR *dir = fdopendir(dir_fd);
+    if (dir == NULL) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] could not read dir '%s' because: %s\n", path, strerror(errno));
+        close(dir_fd);
+        return;
     }
-    
-    Cases cases = {0};
-    char* defines = {0};
-    while ((de = readdir(source_dir)) != NULL) {
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
         if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0)) {
             continue;
         }
-        if (strcmp(de->d_name, DEFIN_FILE) == 0) {
-            defines = read_defin(de->d_name);
-        } else if (is_test_file(de->d_name)) {
-            if (parse_file(&cases, args.dir, de->d_name) == 1) {
+        size_t path_len = strlen(path) + strlen(de->d_name) + 2;
+        char child_rel[strlen(rel_path) + strlen(de->d_name) + 2];
+        sprintf(child_rel, "%s%s%s", rel_path, rel_path[0] == '\0' ? "" : "/", de->d_name);
+
+        unsigned char type = de->d_type;
+        if (type == DT_UNKNOWN || type == DT_LNK) {
+            //symlinked files are followed, symlinked directories are not
+            struct stat st;
+            if (fstatat(dirfd(dir), de->d_name, &st, 0) < 0) {
+                continue;
+            }
+            if (S_ISREG(st.st_mode)) {
+                type = DT_REG;
+            } else if (S_ISDIR(st.st_mode) && type == DT_UNKNOWN) {
+                type = DT_DIR;
+            } else {
+                continue;
+            }
+        }
+
+        if (type == DT_DIR) {
+            if (matches_any(&args.excludes, child_rel, de->d_name)) {
+                continue;
+            }
+            int child_fd = openat(dirfd(dir), de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (child_fd < 0) {
+                fprintf(stderr, LOG_PREFIX"[ERROR] could not open dir '%s/%s' because: %s\n", path, de->d_name, strerror(errno));
+                continue;
+            }
+            char child_path[path_len];
+            sprintf(child_path, "%s/%s", path, de->d_name);
+            walk_dir(queue, child_fd, child_path, child_rel, root, defines);
+        } else if (type == DT_REG) {
+            if (strcmp(de->d_name, DEFIN_FILE) == 0) {
+                //only the one at the top of a source directory counts
+                if (rel_path[0] == '\0' && defines != NULL) {
+                    char* defin = read_defin((char*)path, de->d_name);
+                    append_defines(defines, defin);
+                }
                 continue;
-            }           
-        } 
+            }
+            if (!wants_file(child_rel, de->d_name)) {
+                continue;
+            }
+            char child_path[path_len];
+            sprintf(child_path, "%s/%s", path, de->d_name);
+            push_scan_job(queue, child_path, root);
+        }
     }
-    closedir(source_dir);
+    closedir(dir);
+}
 
-    FILE *tmp_file = fopen("tmp_toast.c", "w");
-    if (tmp_file == NULL) {
-        fprintf(stderr, LOG_PREFIX"[ERROR] opening tmp_toast.c failed\n");
-        return 1;
+int cmp_scan_job(const void *a, const void *b) {
+    const ScanJob *x = *(ScanJob* const*)a, *y = *(ScanJob* const*)b;
+    if (x->root != y->root) {
+        return x->root < y->root ? -1 : 1;
     }
-    write_test_file(&cases, tmp_file, defines);
-    free_cases(cases);
-    fclose(tmp_file);
-    int status;
-    int log_fd = open("logs", O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+    return strcmp(x->path, y->path);
+}
 
-    //fork and run
-    pid_t cpid = fork();
-    if (cpid == 0) {
-        if (dup2(log_fd, STDOUT_FILENO) < 0) {
-            exit(1);
-        }
-        if (dup2(log_fd, STDERR_FILENO) < 0) {
-            exit(1);
+//Appends the cases of every parsed file to [cases], in the order of [files]
+void collect_cases(ScanJobs *files, Cases *cases) {
+    cases->len = 0;
+    for (size_t i = 0; i < files->len; ++i) {
+        if (files->items[i]->failed == 0) {
+            append_many(cases, files->items[i]->cases.items, files->items[i]->cases.len);
         }
-        printf(LOG_PREFIX" spawning child process\n");
-        printf(LOG_PREFIX" compiling test suite: 'tmp_toast.c'\n");
-        char *args[] = {CC, "-o", "tmp_toast", "tmp_toast.c", NULL};
-        execvp(CC, args);
-    }
-    
-   if (cpid > 0) {
-       pid_t pid = wait(&status);
-       int success = WEXITSTATUS(status);
-       if (WIFEXITED(status)) {
-           if (success == 0) {
-                printf(LOG_PREFIX" Compilation successful\n");
-           } else {
-                printf(LOG_PREFIX" Compilation failed. Process exited with %d\n", success);
-               off_t fsize = lseek(log_fd, 0, SEEK_END);
-               char log_buf[fsize+1];
-               lseek(log_fd, 0, SEEK_SET);
-               read(log_fd, log_buf, fsize);
-               log_buf[fsize] = '\0';
-               printf("%s", log_buf);
-               close(log_fd);
-               if (args.keep == 0) {
-                    remove_generated_files(1);
-               }
-               return 1;
-           }
-       }
-
-       //fork again
-       pid = fork();
-
-       if (pid == 0) {
-            if (dup2(log_fd, STDOUT_FILENO) < 0) {
-                exit(1);
+    }
+}
+
+//Walks every source directory and parses the test files on a pool of 
+//threads while they are being found. The files end up in [files] ordered by
+//source directory and path, no matter which worker parsed them.
+int discover_files(ScanJobs *files, char** defines) {
+    ScanQueue queue = {.walking = 1};
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.found, NULL);
+
+    uint64_t start = now_ns();
+    size_t num_workers = num_jobs();
+    pthread_t workers[num_workers];
+    size_t started = 0;
+    for (; started < num_workers; ++started) {
+        if (pthread_create(&workers[started], NULL, scan_worker, &queue) != 0) {
+            break;
+        }
+    }
+
+    int failed = 0;
+    for (size_t root = 0; root < args.dirs.len; ++root) {
+        char* dir = args.dirs.items[root];
+        printf(LOG_PREFIX" Reading dir '%s'.\n", dir);
+        int fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0) {
+            printf(LOG_PREFIX"[ERROR] Source directory %s was not found\n", dir);
+            failed = 1;
+            continue;
+        }
+        walk_dir(&queue, fd, dir, "", root, defines);
+    }
+
+    pthread_mutex_lock(&queue.lock);
+    queue.walking = 0;
+    pthread_cond_broadcast(&queue.found);
+    pthread_mutex_unlock(&queue.lock);
+    if (started == 0) {
+        scan_worker(&queue);
+    }
+    for (size_t i = 0; i < started; ++i) {
+        pthread_join(workers[i], NULL);
+    }
+
+    qsort(queue.items, queue.len, sizeof(ScanJob*), cmp_scan_job);
+    size_t bytes = 0;
+    size_t parsed = 0;
+    size_t num_cases = 0;
+    for (size_t i = 0; i < queue.len; ++i) {
+        ScanJob *job = queue.items[i];
+        if (job->failed == 0) {
+            num_cases += job->cases.len;
+            bytes += job->bytes;
+            parsed++;
+        }
+    }
+    *files = (ScanJobs){.items = queue.items, .len = queue.len, .cap = queue.cap};
+    pthread_cond_destroy(&queue.found);
+    pthread_mutex_destroy(&queue.lock);
+    print_discovery(num_cases, parsed, bytes, now_ns() - start);
+    return failed;
+}
+
+#define HASH_SEED 0xcbf29ce484222325ULL
+
+//FNV-1a, good enough to tell builds apart
+uint64_t hash_bytes(uint64_t h, const void *data, size_t len) {
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t hash_cstr(uint64_t h, const char *s) {
+    //the terminator keeps "ab","c" and "a","bc" apart
+    return hash_bytes(h, s, strlen(s) + 1);
+}
+
+//Hashes the contents of a file, a missing file hashes like an empty one
+uint64_t hash_file(uint64_t h, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return hash_cstr(h, "");
+    }
+    char buf[DEFAULT_CAP*64];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0) {
+        h = hash_bytes(h, buf, n);
+    }
+    fclose(file);
+    return hash_cstr(h, "");
+}
+
+int mkdir_p(const char *path) {
+    char tmp[PATH_CAP];
+    snprintf(tmp, sizeof(tmp), "%s", path);
+    for (char *p = tmp + 1; *p != '\0'; ++p) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = '\0';
+        if (mkdir(tmp, 0755) < 0 && errno != EEXIST) {
+            return -1;
+        }
+        *p = '/';
+    }
+    if (mkdir(tmp, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+//Output of a child, only the first CAPTURE_CAP bytes are kept
+typedef struct {
+    char* buf;
+    size_t len;
+    size_t dropped;
+} Capture;
+
+//Reads what is available on [fd] into [capture], returns 0 on EOF
+ssize_t capture_output(int fd, Capture *capture) {
+    char chunk[4096];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return 1;
+    }
+    if (n <= 0) {
+        return 0;
+    }
+    if (capture->buf == NULL) {
+        capture->buf = malloc(CAPTURE_CAP);
+    }
+    size_t keep = (size_t)n < CAPTURE_CAP - capture->len ? (size_t)n : CAPTURE_CAP - capture->len;
+    memcpy(capture->buf + capture->len, chunk, keep);
+    capture->len += keep;
+    capture->dropped += n - keep;
+    return n;
+}
+
+void print_capture(Capture *capture) {
+    fflush(stdout);
+    ssize_t n = write(STDOUT_FILENO, capture->buf, capture->len);
+    (void)n;
+    if (capture->dropped > 0) {
+        printf(LOG_PREFIX" ... %ld more bytes of output were dropped\n", capture->dropped);
+    }
+}
+
+void free_capture(Capture *capture) {
+    free(capture->buf);
+    *capture = (Capture){0};
+}
+
+//Forks a child with its stdout and stderr on a pipe, whose read end is put
+//into [out_fd]
+pid_t fork_piped(int *out_fd) {
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (dup2(fds[1], STDOUT_FILENO) < 0 || dup2(fds[1], STDERR_FILENO) < 0) {
+            exit(1);
+        }
+        return 0;
+    }
+    close(fds[1]);
+    if (pid < 0) {
+        close(fds[0]);
+        return -1;
+    }
+    *out_fd = fds[0];
+    return pid;
+}
+
+//Passes everything read from [fd] on to stdout as it comes, spliced when
+//stdout allows it, copied through a fixed buffer otherwise. Stops at the end
+//of [fd], or once a line arrived on [status_fd] (if it isn't -1) and [fd] has
+//nothing left. Gives up once [deadline_ns] passed, unless it is 0. Returns 1
+//if it gave up.
+int relay_output(int fd, int status_fd, uint64_t deadline_ns) {
+    fflush(stdout);
+    int can_splice = 1;
+    int done = 0;
+    char chunk[RELAY_CHUNK];
+    struct pollfd pfds[2] = {
+        {.fd = fd, .events = POLLIN},
+        {.fd = status_fd, .events = POLLIN},
+    };
+    while (1) {
+        int timeout = -1;
+        if (done) {
+            timeout = 0;
+        } else if (deadline_ns > 0) {
+            uint64_t now = now_ns();
+            if (now >= deadline_ns) {
+                return 1;
             }
-            if (dup2(log_fd, STDERR_FILENO) < 0) {
-                exit(1);
+            timeout = (int)((deadline_ns - now)/1000000) + 1;
+        }
+        int ready = poll(pfds, status_fd >= 0 ? 2 : 1, timeout);
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            if (done || ready < 0) {
+                return 0;
+            }
+            continue;
+        }
+        if (status_fd >= 0 && pfds[1].revents != 0) {
+            //output written before the status is in the pipe already
+            char status[64];
+            ssize_t n = read(status_fd, status, sizeof(status));
+            (void)n;
+            done = 1;
+            pfds[1].fd = -1;
+        }
+        if (pfds[0].revents == 0) {
+            continue;
+        }
+        ssize_t n;
+        if (can_splice) {
+            n = splice(fd, NULL, STDOUT_FILENO, NULL, RELAY_CHUNK, SPLICE_F_MOVE);
+            if (n < 0 && errno == EINVAL) {
+                can_splice = 0; //e.g. stdout is a terminal
+                continue;
+            }
+        } else {
+            n = read(fd, chunk, sizeof(chunk));
+            for (ssize_t off = 0; off < n; ) {
+                ssize_t written = write(STDOUT_FILENO, chunk + off, n - off);
+                if (written < 0 && errno != EINTR) {
+                    break;
+                }
+                off += written > 0 ? written : 0;
+            }
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return 0;
+        }
+    }
+}
+
+typedef struct {
+    char* file_name; //test file the unit was generated from, NULL for main
+    char src[PATH_CAP];
+    char obj[PATH_CAP];
+    uint64_t key;
+    //key of the source and flags alone, the depfile is named after it
+    uint64_t src_key;
+    //hash of the headers the unit included when it was compiled last
+    uint64_t deps;
+    const char *ext; //of the object, ".o" or ".so"
+    uint64_t reg_id; //suffix of the unit's registration function
+    const char **flags; //compiler flags, cflags if NULL
+    int direct; //compiled from the test file itself, [flags] are its own
+    int generated; //[src] was written to the cache by toaster
+} Unit;
+
+typedef struct {
+    Unit* items;
+    size_t len;
+    size_t cap;
+} Units;
+
+//Key of a compiled unit: its source, toast.h, the compiler and its flags
+//Folds in everything besides the source that changes what a unit compiles to
+uint64_t toolchain_key(uint64_t h, const char **flags) {
+    h = hash_file(h, TOAST_HEADER);
+    h = hash_cstr(h, args.cc);
+    for (size_t i = 0; flags[i] != NULL; ++i) {
+        h = hash_cstr(h, flags[i]);
+    }
+    return h;
+}
+
+uint64_t unit_key(Str *source) {
+    return toolchain_key(hash_bytes(HASH_SEED, source->items, source->len), cflags);
+}
+
+//Content hash of a file a unit depends on, read once per build
+typedef struct {
+    char* path;
+    uint64_t hash;
+} DepHash;
+
+typedef struct {
+    DepHash* items;
+    size_t len;
+    size_t cap;
+} DepHashes;
+
+DepHashes dep_hashes = {0};
+//`<deps hash>:<file>` of every test file, the runner mixes them into the memo
+//keys of the file's cases
+Cmd memo_deps = {0};
+
+//Headers may have changed since the last build, e.g. in --watch
+void forget_dep_hashes() {
+    for (size_t i = 0; i < dep_hashes.len; ++i) {
+        free(dep_hashes.items[i].path);
+    }
+    dep_hashes.len = 0;
+}
+
+uint64_t hash_dep(uint64_t h, const char *path) {
+    for (size_t i = 0; i < dep_hashes.len; ++i) {
+        if (strcmp(dep_hashes.items[i].path, path) == 0) {
+            return hash_bytes(h, &dep_hashes.items[i].hash, sizeof(uint64_t));
+        }
+    }
+    DepHash dep = {.path = strdup(path), .hash = hash_file(HASH_SEED, path)};
+    append_one(&dep_hashes, dep);
+    return hash_bytes(h, &dep.hash, sizeof(uint64_t));
+}
+
+//Depfile the compiler writes for [unit] (-MMD), named after its source key so
+//the next build finds it before compiling
+void dep_path(Unit *unit, char *buf, size_t cap) {
+    snprintf(buf, cap, "%s/deps/%016llx.d", args.cache_dir, (unsigned long long)unit->src_key);
+}
+
+//Hashes the paths and contents of the files [unit] included when it was
+//compiled last, e.g. the code under test defin.test.c includes. Its own
+//source is covered by its source key already. A unit without a depfile was
+//never compiled, so there is no object to reuse anyway.
+uint64_t hash_deps(Unit *unit) {
+    char path[PATH_CAP + 32];
+    dep_path(unit, path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return hash_cstr(HASH_SEED, "never compiled");
+    }
+    uint64_t h = HASH_SEED;
+    char dep[PATH_CAP];
+    size_t len = 0;
+    int target = 1;
+    int c;
+    //`target: dep dep \<newline> dep`, spaces in paths are escaped
+    while ((c = fgetc(file)) != EOF) {
+        int escaped = 0;
+        if (c == '\\') {
+            int next = fgetc(file);
+            if (next == ' ' || next == '#' || next == '\\') {
+                c = next;
+                escaped = 1;
+            } else if (next == '\n' || next == EOF) {
+                c = ' ';
+            } else {
+                ungetc(next, file);
+            }
+        } else if (c == '$') {
+            int next = fgetc(file);
+            if (next != '$') {
+                ungetc(next, file);
+            }
+        }
+        if (!escaped && target && c == ':') {
+            target = 0;
+            len = 0;
+            continue;
+        }
+        if (escaped || (c != ' ' && c != '\t' && c != '\n' && c != '\r')) {
+            if (len + 1 < sizeof(dep)) {
+                dep[len++] = c;
+            }
+            continue;
+        }
+        dep[len] = '\0';
+        if (!target && len > 0 && strcmp(dep, unit->src) != 0) {
+            h = hash_dep(hash_cstr(h, dep), dep);
+        }
+        len = 0;
+    }
+    dep[len] = '\0';
+    if (!target && len > 0 && strcmp(dep, unit->src) != 0) {
+        h = hash_dep(hash_cstr(h, dep), dep);
+    }
+    fclose(file);
+    return h;
+}
+
+//Key and object path of [unit]: its source key and the contents of what it
+//includes
+void key_unit(Unit *unit) {
+    unit->deps = hash_deps(unit);
+    unit->key = hash_bytes(unit->src_key, &unit->deps, sizeof(unit->deps));
+    snprintf(unit->obj, sizeof(unit->obj), "%s/obj/%016llx%s", args.cache_dir, (unsigned long long)unit->key, unit->ext);
+}
+
+//Key of a binary linked from [units] with [flags], it only depends on their
+//objects
+uint64_t link_key(uint64_t h, Units *units, const char **flags) {
+    h = hash_cstr(h, args.cc);
+    for (size_t i = 0; flags[i] != NULL; ++i) {
+        h = hash_cstr(h, flags[i]);
+    }
+    for (size_t i = 0; i < units->len; ++i) {
+        h = hash_bytes(h, &units->items[i].key, sizeof(units->items[i].key));
+    }
+    return h;
+}
+
+//Appends [str] as a C string literal
+void append_c_string(Str *data, const char *str) {
+    append_one(data, '"');
+    for (; *str != '\0'; ++str) {
+        if (*str == '"' || *str == '\\') {
+            append_one(data, '\\');
+        }
+        append_one(data, *str);
+    }
+    append_one(data, '"');
+}
+
+//Registers the fixture of a setup hook, along with the teardown hook of the
+//same name and scope if the file has one
+void append_fixture(Str *data, Cases *cases, size_t start, size_t end, Case *setup) {
+    size_t len;
+    int suite;
+    const char *name = fixture_name(setup, &len, &suite);
+    append_many(data, "  insert_fixture(pack, (ToastFixture){.name = \"", 47);
+    append_many(data, name, len);
+    append_many(data, "\", .file = ", 11);
+    if (suite) {
+        append_many(data, "NULL", 4);
+    } else {
+        append_c_string(data, setup->file_name);
+    }
+    append_many(data, ", .setup = ", 11);
+    append_many(data, setup->function + setup->s, setup->l);
+    append_many(data, ", .teardown = ", 14);
+    Case *teardown = NULL;
+    for (size_t i = start; i < end && teardown == NULL; ++i) {
+        Case *item = &cases->items[i];
+        size_t l;
+        int s;
+        if (item->kind != CASE_TEARDOWN) {
+            continue;
+        }
+        const char *n = fixture_name(item, &l, &s);
+        if (s == suite && l == len && memcmp(n, name, len) == 0) {
+            teardown = item;
+        }
+    }
+    if (teardown != NULL) {
+        append_many(data, teardown->function + teardown->s, teardown->l);
+    } else {
+        append_many(data, "NULL", 4);
+    }
+    append_many(data, "});\n", 4);
+}
+
+//One translation unit per test file: defin.test.c, the cases and a function
+//inserting them, so even `static` cases can be registered from main.
+//[weak] (may be NULL) turns what defin.test.c defines into weak copies, the
+//definitions of its own unit win at link time.
+//Each slice gets a memo key from [memo_seed], its file and its function, the
+//runner skips slices whose key passed before.
+Str generate_file_unit(Cases *cases, size_t start, size_t end, char* defines, Str *weak, uint64_t reg_id, uint64_t memo_seed) {
+    Str data = {0};
+    char line[256];
+
+    append_many(&data, unit_header, sizeof(unit_header)-1);
+    if (defines != NULL && defines[0] != '\0') {
+        append_many(&data, defines, strlen(defines));
+        append_one(&data, '\n');
+    }
+    if (weak != NULL) {
+        append_many(&data, weak->items, weak->len);
+    }
+    for (size_t i = start; i < end; ++i) {
+        append_many(&data, cases->items[i].function, cases->items[i].len);
+    }
+
+    int n = snprintf(line, sizeof(line), "\n\nvoid toast_register_%016llx(PackOfToast *pack) {\n", (unsigned long long)reg_id);
+    append_many(&data, line, n);
+    for (size_t i = start; i < end; ++i) {
+        Case *item = &cases->items[i];
+        if (item->kind == CASE_SETUP) {
+            append_fixture(&data, cases, start, end, item);
+        }
+        if (item->kind == CASE_SETUP || item->kind == CASE_TEARDOWN || item->kind == CASE_HELPER) {
+            continue;
+        }
+        append_many(&data, "  insert_toast(pack, (SliceOfToast){", 36);
+        if (item->kind == CASE_BENCH) {
+            append_many(&data, ".bench = ", 9);
+        } else if (item->kind == CASE_FUZZ) {
+            append_many(&data, ".fuzz = ", 8);
+        } else {
+            append_many(&data, ".toast = ", 9);
+        }
+        append_many(&data, item->function + item->s, item->l);
+        append_many(&data, ", .name = \"", 11);
+        append_many(&data, item->function + item->s, item->l);
+        append_many(&data, "\", .file = ", 11);
+        append_c_string(&data, item->file_name);
+        n = snprintf(line, sizeof(line), ", .result = RAW, .memo_key = 0x%016llxULL});\n", 
+                (unsigned long long)hash_cstr(hash_cstr(memo_seed, item->file_name), item->function));
+        append_many(&data, line, n);
+    }
+    append_many(&data, "}\n", 2);
+    return data;
+}
+
+//The unit with main() and the toast implementation, it only calls the
+//registration functions of the test file units.
+Str generate_main_unit(Units *units) {
+    Str data = {0};
+    char line[256];
+
+    append_many(&data, main_header, sizeof(main_header)-1);
+    for (size_t i = 0; i < units->len; ++i) {
+        if (units->items[i].file_name == NULL || units->items[i].direct) {
+            continue;
+        }
+        int n = snprintf(line, sizeof(line), "void toast_register_%016llx(PackOfToast *pack);\n", 
+                (unsigned long long)units->items[i].reg_id);
+        append_many(&data, line, n);
+    }
+    append_many(&data, main_decl, sizeof(main_decl)-1);
+    for (size_t i = 0; i < units->len; ++i) {
+        if (units->items[i].file_name == NULL || units->items[i].direct) {
+            continue;
+        }
+        int n = snprintf(line, sizeof(line), "  toast_register_%016llx(&pack); // %s\n", 
+                (unsigned long long)units->items[i].reg_id, units->items[i].file_name);
+        append_many(&data, line, n);
+    }
+    append_many(&data, main_close, sizeof(main_close)-1);
+    return data;
+}
+
+int write_file(const char *path, Str *data) {
+    FILE *file = fopen(path, "w");
+    if (file == NULL) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] opening '%s' failed (%s)\n", path, strerror(errno));
+        return 1;
+    }
+    if (fwrite(data->items, 1, data->len, file) < data->len) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] writing to '%s' failed\n", path);
+        fclose(file);
+        return 1;
+    };
+    fclose(file);
+    return 0;
+}
+
+//Fills in the object path of a unit and writes its source to the cache
+//unless the object is already cached and the source isn't to be kept
+int prepare_unit(Unit *unit, Str *source, const char *ext) {
+    unit->src_key = unit_key(source);
+    unit->ext = ext;
+    unit->generated = 1;
+    snprintf(unit->src, sizeof(unit->src), "%s/src/%016llx.c", args.cache_dir, (unsigned long long)unit->src_key);
+    key_unit(unit);
+    if (args.keep == 0 && access(unit->obj, R_OK) == 0) {
+        return 0;
+    }
+    return write_file(unit->src, source);
+}
+
+//A test file using TOAST() is compiled as it is, toast.h and defin.test.c
+//([defin_path], may be NULL) are included on the command line. Its slices
+//share a memo key covering the file, TOAST() mixes in their names.
+void prepare_direct_unit(Unit *unit, const char *defin_path, uint64_t memo_seed, const char *ext) {
+    size_t num_cflags = 0;
+    while (cflags[num_cflags] != NULL) {
+        num_cflags++;
+    }
+    //the flags and the defines they point to live in one allocation
+    const char **flags = malloc(sizeof(char*)*(num_cflags + 8) + 128);
+    char *memo_define = (char*)(flags + num_cflags + 8);
+    char *module_define = memo_define + 64;
+    uint64_t file_key = hash_file(hash_cstr(memo_seed, unit->file_name), unit->file_name);
+    snprintf(memo_define, 64, "-DTOAST_MEMO_KEY=0x%016llxULL", (unsigned long long)file_key);
+    snprintf(module_define, 64, "-DTOAST_MODULE=toast_register_%016llx", (unsigned long long)unit->reg_id);
+    size_t n = 0;
+    for (; n < num_cflags; ++n) {
+        flags[n] = cflags[n];
+    }
+    flags[n++] = "-include";
+    flags[n++] = TOAST_HEADER;
+    if (defin_path != NULL) {
+        flags[n++] = "-include";
+        flags[n++] = defin_path;
+    }
+    flags[n++] = memo_define;
+    if (strcmp(ext, ".so") == 0) {
+        flags[n++] = module_define;
+    }
+    flags[n] = NULL;
+    unit->flags = flags;
+    unit->direct = 1;
+    unit->src_key = toolchain_key(file_key, flags);
+    unit->ext = ext;
+    snprintf(unit->src, sizeof(unit->src), "%s", unit->file_name);
+    key_unit(unit);
+}
+
+pid_t spawn_compiler(Unit *unit, int *out_fd) {
+    pid_t pid = fork_piped(out_fd);
+    if (pid == 0) {
+        char part_path[PATH_CAP + 8];
+        snprintf(part_path, sizeof(part_path), "%s.part", unit->obj);
+        char dep[PATH_CAP + 32], dep_part[PATH_CAP + 40];
+        dep_path(unit, dep, sizeof(dep));
+        snprintf(dep_part, sizeof(dep_part), "%s.part", dep);
+        const char **flags = unit->flags != NULL ? unit->flags : cflags;
+        Cmd cmd = {0};
+        append_one(&cmd, args.cc);
+        for (size_t i = 0; flags[i] != NULL; ++i) {
+            append_one(&cmd, (char*)flags[i]);
+        }
+        append_one(&cmd, "-MMD");
+        append_one(&cmd, "-MF");
+        append_one(&cmd, dep_part);
+        size_t len = strlen(unit->obj);
+        //modules for --watch are built as shared objects right away
+        append_one(&cmd, len > 3 && strcmp(unit->obj + len - 3, ".so") == 0 ? "-shared" : "-c");
+        append_one(&cmd, "-o");
+        append_one(&cmd, part_path);
+        append_one(&cmd, unit->src);
+        append_one(&cmd, NULL);
+        execvp(args.cc, cmd.items);
+        exit(127);
+    }
+    return pid;
+}
+
+//A compiler process and the output it printed so far
+typedef struct {
+    pid_t pid;
+    int fd;
+    size_t unit;
+    Capture output;
+} Compile;
+
+//Compiles every unit without a cached object, at most [jobs] at a time. 
+//Objects are built next to their final name and only moved into place once 
+//they are complete, so an interrupted build never ends up in the cache.
+//They are moved to the key of what they actually included, which may differ
+//from what they included the last time.
+//Compiler output is collected from pipes and only shown for failed units.
+int compile_units(Units *units, size_t jobs) {
+    Compile *running = calloc(jobs, sizeof(Compile));
+    struct pollfd *pfds = calloc(jobs, sizeof(struct pollfd));
+    size_t active = 0;
+    size_t next = 0;
+    size_t compiled = 0;
+    int failed = 0;
+    while (next < units->len || active > 0) {
+        while (failed == 0 && active < jobs && next < units->len) {
+            Unit *unit = &units->items[next++];
+            if (access(unit->obj, R_OK) == 0) {
+                continue;
+            }
+            Compile compile = {.unit = next - 1};
+            compile.pid = spawn_compiler(unit, &compile.fd);
+            if (compile.pid < 0) {
+                fprintf(stderr, LOG_PREFIX"[ERROR] fork failed (%s)\n", strerror(errno));
+                failed = 1;
+                break;
+            }
+            running[active++] = compile;
+        }
+        if (active == 0) {
+            break;
+        }
+        for (size_t slot = 0; slot < active; ++slot) {
+            pfds[slot] = (struct pollfd){.fd = running[slot].fd, .events = POLLIN};
+        }
+        if (poll(pfds, active, -1) < 0 && errno != EINTR) {
+            fprintf(stderr, LOG_PREFIX"[ERROR] poll failed (%s)\n", strerror(errno));
+            failed = 1;
+            break;
+        }
+        for (size_t slot = active; slot-- > 0; ) {
+            if (pfds[slot].revents == 0 || capture_output(running[slot].fd, &running[slot].output) > 0) {
+                continue;
+            }
+            //the compiler closed its end, so it is done
+            Compile *compile = &running[slot];
+            close(compile->fd);
+            int status;
+            waitpid(compile->pid, &status, 0);
+            Unit *unit = &units->items[compile->unit];
+            char part_path[PATH_CAP + 8];
+            snprintf(part_path, sizeof(part_path), "%s.part", unit->obj);
+            char dep[PATH_CAP + 32], dep_part[PATH_CAP + 40];
+            dep_path(unit, dep, sizeof(dep));
+            snprintf(dep_part, sizeof(dep_part), "%s.part", dep);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                printf(LOG_PREFIX" Compiling '%s' failed. Process exited with %d\n", 
+                        unit->file_name != NULL ? unit->file_name : unit->src, WEXITSTATUS(status));
+                print_capture(&compile->output);
+                remove(part_path);
+                remove(dep_part);
+                failed = 1;
+            } else if (rename(dep_part, dep) < 0) {
+                fprintf(stderr, LOG_PREFIX"[ERROR] moving '%s' into the cache failed (%s)\n", dep_part, strerror(errno));
+                failed = 1;
+            } else {
+                //the object is keyed by what it included this time
+                key_unit(unit);
+                if (rename(part_path, unit->obj) < 0) {
+                    fprintf(stderr, LOG_PREFIX"[ERROR] moving '%s' into the cache failed (%s)\n", part_path, strerror(errno));
+                    failed = 1;
+                } else {
+                    compiled++;
+                    if (unit->generated && args.keep == 0) {
+                        remove(unit->src);
+                    }
+                }
+            }
+            free_capture(&compile->output);
+            running[slot] = running[--active];
+        }
+    }
+    free(running);
+    free(pfds);
+    if (failed) {
+        return 1;
+    }
+    printf(LOG_PREFIX" Compilation successful, %ld/%ld units were up to date\n", units->len - compiled, units->len);
+    return 0;
+}
+
+//Links the objects of all units into [bin_path], via a temporary file like
+//the objects
+int link_units(Units *units, char *bin_path, const char **ldflags) {
+    char part_path[PATH_CAP + 8];
+    snprintf(part_path, sizeof(part_path), "%s.part", bin_path);
+    int out_fd = -1;
+    pid_t pid = fork_piped(&out_fd);
+    if (pid == 0) {
+        Cmd cmd = {0};
+        append_one(&cmd, args.cc);
+        for (size_t i = 0; cflags[i] != NULL; ++i) {
+            append_one(&cmd, (char*)cflags[i]);
+        }
+        append_one(&cmd, "-o");
+        append_one(&cmd, part_path);
+        for (size_t i = 0; ldflags != NULL && ldflags[i] != NULL; ++i) {
+            append_one(&cmd, (char*)ldflags[i]);
+        }
+        char rpath[PATH_CAP + 16];
+        for (size_t i = 0; i < units->len; ++i) {
+            char *obj = units->items[i].obj;
+            append_one(&cmd, obj);
+            size_t len = strlen(obj);
+            char *dir = len > 3 && strcmp(obj + len - 3, ".so") == 0 ? realpath(obj, NULL) : NULL;
+            if (dir != NULL) {
+                //so the test suite finds a shared libtoast wherever it is run from
+                *strrchr(dir, '/') = '\0';
+                snprintf(rpath, sizeof(rpath), "-Wl,-rpath,%s", dir);
+                append_one(&cmd, rpath);
+            }
+        }
+        append_one(&cmd, NULL);
+        execvp(args.cc, cmd.items);
+        exit(127);
+    }
+    if (pid < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] fork failed (%s)\n", strerror(errno));
+        return 1;
+    }
+    Capture output = {0};
+    while (capture_output(out_fd, &output) > 0);
+    close(out_fd);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        printf(LOG_PREFIX" Linking failed. Process exited with %d\n", WEXITSTATUS(status));
+        print_capture(&output);
+        free_capture(&output);
+        remove(part_path);
+        return 1;
+    }
+    free_capture(&output);
+    if (rename(part_path, bin_path) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] moving '%s' into the cache failed (%s)\n", part_path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+//Appends `#pragma weak <name>` to [pragmas] for every global symbol the
+//object [obj] defines
+int weaken_symbols(const char *obj, Str *pragmas) {
+    int out_fd = -1;
+    pid_t pid = fork_piped(&out_fd);
+    if (pid == 0) {
+        execlp("nm", "nm", "-g", "--defined-only", "-P", obj, (char*)NULL);
+        exit(127);
+    }
+    if (pid < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] fork failed (%s)\n", strerror(errno));
+        return 1;
+    }
+    FILE *out = fdopen(out_fd, "r");
+    char *line = NULL;
+    size_t cap = 0;
+    //`name type value size`, symbols that are weak already stay as they are
+    while (getline(&line, &cap, out) > 0) {
+        char *type = strchr(line, ' ');
+        if (type == NULL || type[1] == '\0' || type[2] != ' ' || type[1] == 'W' || type[1] == 'V') {
+            continue;
+        }
+        append_many(pragmas, "#pragma weak ", 13);
+        append_many(pragmas, line, (size_t)(type - line));
+        append_one(pragmas, '\n');
+    }
+    free(line);
+    fclose(out);
+    int status;
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] listing the symbols of '%s' with nm failed\n", obj);
+        return 1;
+    }
+    return 0;
+}
+
+//defin.test.c is compiled once into a unit of its own, the test file units
+//need it for its declarations, types and macros. What it defines, e.g. a .c
+//file it includes, would be defined by every one of them, they get weak
+//copies instead. Compiled ahead of the others, its symbols are needed for
+//their sources. Fills [weak] with the pragmas.
+int prepare_defines_unit(Unit *unit, char *defines, Str *weak) {
+    Str source = {0};
+    append_many(&source, unit_header, sizeof(unit_header)-1);
+    append_many(&source, defines, strlen(defines));
+    append_one(&source, '\n');
+    int failed = prepare_unit(unit, &source, ".o");
+    str_free(source);
+    if (failed) {
+        return 1;
+    }
+    Units one = {.items = unit, .len = 1};
+    if (access(unit->obj, R_OK) != 0 && compile_units(&one, 1) != 0) {
+        return 1;
+    }
+    return weaken_symbols(unit->obj, weak);
+}
+
+//Splits the cases into one unit per test file plus the main unit and builds
+//the test suite from them into [bin_path]. If [modules] isn't NULL the test
+//files are built into shared objects instead, which end up in [modules], and
+//[bin_path] is the persistent runner loading them.
+int build_test_suite(Cases *cases, char* defines, char *bin_path, Units *modules) {
+    char dir[PATH_CAP];
+    snprintf(dir, sizeof(dir), "%s/obj", args.cache_dir);
+    if (mkdir_p(dir) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] creating cache dir '%s' failed (%s)\n", dir, strerror(errno));
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/src", args.cache_dir);
+    if (mkdir_p(dir) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] creating cache dir '%s' failed (%s)\n", dir, strerror(errno));
+        return 1;
+    }
+    snprintf(dir, sizeof(dir), "%s/deps", args.cache_dir);
+    if (mkdir_p(dir) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] creating cache dir '%s' failed (%s)\n", dir, strerror(errno));
+        return 1;
+    }
+    forget_dep_hashes();
+
+    //a case's result holds as long as it, defin.test.c and the toolchain do
+    uint64_t memo_seed = hash_cstr(toolchain_key(HASH_SEED, cflags), defines != NULL ? defines : "");
+    //modules for --watch are shared objects each, their copies don't collide
+    Unit defines_unit = {0};
+    Str weak = {0};
+    int has_defines = defines != NULL && defines[0] != '\0';
+    if (has_defines && modules == NULL && prepare_defines_unit(&defines_unit, defines, &weak) != 0) {
+        str_free(weak);
+        return 1;
+    }
+    //files compiled as they are include defin.test.c from the cache
+    char defin_path[PATH_CAP];
+    if (has_defines) {
+        Str defin = {0};
+        append_many(&defin, defines, strlen(defines));
+        append_one(&defin, '\n');
+        append_many(&defin, weak.items, weak.len);
+        snprintf(defin_path, sizeof(defin_path), "%s/src/%016llx.h", args.cache_dir, 
+                (unsigned long long)unit_key(&defin));
+        int failed = access(defin_path, R_OK) != 0 && write_file(defin_path, &defin) != 0;
+        str_free(defin);
+        if (failed) {
+            str_free(weak);
+            return 1;
+        }
+    }
+    Units units = {0};
+    size_t start = 0;
+    //cases of a file are parsed one after another
+    for (size_t i = 1; i <= cases->len; ++i) {
+        if (i < cases->len && strcmp(cases->items[i].file_name, cases->items[start].file_name) == 0) {
+            continue;
+        }
+        Unit unit = {
+            .file_name = cases->items[start].file_name,
+            .reg_id = hash_cstr(HASH_SEED, cases->items[start].file_name),
+        };
+        if (cases->items[start].kind == CASE_FILE) {
+            prepare_direct_unit(&unit, has_defines ? defin_path : NULL, 
+                    memo_seed, modules != NULL ? ".so" : ".o");
+            append_one(&units, unit);
+            start = i;
+            continue;
+        }
+        Str source = generate_file_unit(cases, start, i, defines, &weak, unit.reg_id, memo_seed);
+        int failed = prepare_unit(&unit, &source, modules != NULL ? ".so" : ".o");
+        str_free(source);
+        if (failed) {
+            str_free(weak);
+            return 1;
+        }
+        append_one(&units, unit);
+        start = i;
+    }
+
+    size_t num_modules = units.len;
+    Unit main_unit = {0};
+    if (modules != NULL) {
+        Str host = {0};
+        append_many(&host, host_source, sizeof(host_source)-1);
+        int failed = prepare_unit(&main_unit, &host, ".o");
+        str_free(host);
+        if (failed) {
+            return 1;
+        }
+    } else {
+        Str main_source = generate_main_unit(&units);
+        if (prepare_unit(&main_unit, &main_source, ".o") != 0) {
+            return 1;
+        }
+        str_free(main_source);
+    }
+    str_free(weak);
+    append_one(&units, main_unit);
+    if (has_defines && modules == NULL) {
+        append_one(&units, defines_unit);
+    }
+
+    //generated units only declare toast's functions, the implementation comes
+    //prebuilt from libtoast or is compiled once into the cache
+    Unit runtime = {.flags = runtime_flags};
+    if (args.libtoast != NULL) {
+        snprintf(runtime.obj, sizeof(runtime.obj), "%s", args.libtoast);
+        runtime.key = hash_file(HASH_SEED, args.libtoast);
+    } else {
+        snprintf(runtime.src, sizeof(runtime.src), "%s", TOAST_HEADER);
+        runtime.src_key = toolchain_key(hash_cstr(HASH_SEED, "runtime"), runtime_flags);
+        runtime.ext = ".o";
+        key_unit(&runtime);
+    }
+    append_one(&units, runtime);
+
+    snprintf(bin_path, PATH_CAP, "%s/%016llx", args.cache_dir, (unsigned long long)link_key(HASH_SEED, &units, ldflags));
+
+    int failed = 0;
+    if (modules != NULL) {
+        //the runner doesn't change with the test files, modules are linked
+        //as they are compiled
+        Units host = {.items = units.items + num_modules, .len = units.len - num_modules};
+        failed = compile_units(&units, num_jobs());
+        snprintf(bin_path, PATH_CAP, "%s/%016llx", args.cache_dir, 
+                (unsigned long long)link_key(hash_cstr(HASH_SEED, "host"), &host, host_ldflags));
+        if (failed == 0 && access(bin_path, X_OK) != 0) {
+            failed = link_units(&host, bin_path, host_ldflags);
+        }
+        for (size_t i = 0; i < num_modules; ++i) {
+            if (units.items[i].direct) {
+                free(units.items[i].flags);
+                units.items[i].flags = NULL;
+            }
+        }
+        modules->len = 0;
+        append_many(modules, units.items, num_modules);
+    } else if (access(bin_path, X_OK) == 0) {
+        printf(LOG_PREFIX" Sources unchanged, using cached build '%s'\n", bin_path);
+    } else {
+        failed = compile_units(&units, num_jobs());
+        //compiling keyed the objects by what they included
+        snprintf(bin_path, PATH_CAP, "%s/%016llx", args.cache_dir, (unsigned long long)link_key(HASH_SEED, &units, ldflags));
+        if (failed == 0 && access(bin_path, X_OK) != 0) {
+            failed = link_units(&units, bin_path, ldflags);
+        }
+    }
+    for (size_t i = 0; i < memo_deps.len; ++i) {
+        free(memo_deps.items[i]);
+    }
+    memo_deps.len = 0;
+    for (size_t i = 0; i < num_modules; ++i) {
+        size_t len = strlen(units.items[i].file_name) + 18;
+        char *dep = malloc(len);
+        snprintf(dep, len, "%016llx:%s", (unsigned long long)units.items[i].deps, units.items[i].file_name);
+        append_one(&memo_deps, dep);
+    }
+    for (size_t i = 0; modules == NULL && i < num_modules; ++i) {
+        if (units.items[i].direct) {
+            free(units.items[i].flags);
+        }
+    }
+    free(units.items);
+    return failed;
+}
+
+uint64_t suite_deadline() {
+    if (args.suite_timeout == NULL) {
+        return 0;
+    }
+    return now_ns() + (strtoull(args.suite_timeout, NULL, 10) + SUITE_GRACE_MS)*1000000;
+}
+
+//Revision the history is tagged with, "unknown" outside of a git checkout
+const char *git_revision() {
+    static char revision[80]; //as long as the history keeps them
+    if (revision[0] != '\0') {
+        return revision;
+    }
+    snprintf(revision, sizeof(revision), "unknown");
+    FILE *git = popen("git describe --always --dirty 2>/dev/null", "r");
+    if (git == NULL) {
+        return revision;
+    }
+    char line[sizeof(revision)];
+    if (fgets(line, sizeof(line), git) != NULL && line[0] != '\n') {
+        line[strcspn(line, "\n")] = '\0';
+        snprintf(revision, sizeof(revision), "%s", line);
+    }
+    pclose(git);
+    return revision;
+}
+
+//Options toaster hands on to the test suite
+void append_runner_args(Cmd *cmd, Cmd *only_files) {
+    static char memo_path[PATH_CAP];
+    static char history_path[PATH_CAP];
+    append_one(cmd, "--build");
+    append_one(cmd, build_info);
+    append_one(cmd, "--jobs");
+    append_one(cmd, args.jobs);
+    if (args.isolate) {
+        append_one(cmd, "--isolate");
+    }
+    //cached passes have no timing, a history or comparison asked for needs
+    //every case run
+    if (args.no_cache == 0 && args.history == NULL && args.compare == NULL) {
+        snprintf(memo_path, sizeof(memo_path), "%s/"MEMO_FILE, args.cache_dir);
+        append_one(cmd, "--memo");
+        append_one(cmd, memo_path);
+        for (size_t i = 0; i < memo_deps.len; ++i) {
+            append_one(cmd, "--memo-deps");
+            append_one(cmd, memo_deps.items[i]);
+        }
+    }
+    //timings of different profiles don't compare, each keeps its own history
+    if (args.history != NULL) {
+        snprintf(history_path, sizeof(history_path), "%s", args.history);
+    } else {
+        snprintf(history_path, sizeof(history_path), "%s/"HISTORY_FILE".%s", args.cache_dir, args.profile);
+    }
+    append_one(cmd, "--history");
+    append_one(cmd, history_path);
+    append_one(cmd, "--revision");
+    append_one(cmd, (char*)git_revision());
+    if (args.compare != NULL) {
+        append_one(cmd, "--compare");
+        append_one(cmd, args.compare);
+    }
+    if (args.timeout != NULL) {
+        append_one(cmd, "--timeout");
+        append_one(cmd, args.timeout);
+    }
+    if (args.suite_timeout != NULL) {
+        append_one(cmd, "--suite-timeout");
+        append_one(cmd, args.suite_timeout);
+    }
+    for (size_t i = 0; i < args.filters.len; ++i) {
+        append_one(cmd, "--filter");
+        append_one(cmd, args.filters.items[i]);
+    }
+    if (args.reporter != NULL) {
+        append_one(cmd, "--reporter");
+        append_one(cmd, args.reporter);
+    }
+    if (args.shard != NULL) {
+        append_one(cmd, "--shard");
+        append_one(cmd, args.shard);
+    }
+    for (size_t i = 0; only_files != NULL && i < only_files->len; ++i) {
+        append_one(cmd, "--file");
+        append_one(cmd, only_files->items[i]);
+    }
+    for (int i = 0; i < args.runner_argc; ++i) {
+        append_one(cmd, args.runner_args[i]);
+    }
+}
+
+//Runs the test suite, only the slices from [only_files] if it isn't empty.
+//Its output is relayed through a pipe as it comes. Fails if the suite does,
+//which it does on regressions.
+int run_test_suite(char *bin_path, Cmd *only_files) {
+    printf(LOG_PREFIX " Running test suite\n");
+    int out_fd = -1;
+    pid_t pid = fork_piped(&out_fd);
+    if (pid == 0) {
+        Cmd cmd = {0};
+        append_one(&cmd, bin_path);
+        append_runner_args(&cmd, only_files);
+        append_one(&cmd, NULL);
+        execv(cmd.items[0], cmd.items);
+        exit(127);
+    }
+    if (pid < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] fork failed (%s)\n", strerror(errno));
+        return 1;
+    }
+    //the test suite enforces the suite timeout itself, this is the backstop
+    //for a suite that hangs outside of its slices
+    if (relay_output(out_fd, -1, suite_deadline())) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] test suite is still running %dms after its timeout, killing it\n", SUITE_GRACE_MS);
+        kill(pid, SIGKILL);
+    }
+    close(out_fd);
+    int status;
+    waitpid(pid, &status, 0);
+    return !WIFEXITED(status) || WEXITSTATUS(status) != 0;
+}
+
+#define DEBOUNCE_MS 100
+#define WATCH_EVENTS (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR)
+
+//A watched directory
+typedef struct {
+    int wd;
+    char* path;
+    char* rel_path; //relative to its source directory
+    size_t root;
+} Watch;
+
+typedef struct {
+    Watch* items;
+    size_t len;
+    size_t cap;
+} Watches;
+
+void watch_dirs(int inotify_fd, Watches *watches, const char *path, const char *rel_path, size_t root) {
+    int wd = inotify_add_watch(inotify_fd, path, WATCH_EVENTS);
+    if (wd < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] could not watch '%s' because: %s\n", path, strerror(errno));
+        return;
+    }
+    Watch watch = {.wd = wd, .path = strdup(path), .rel_path = strdup(rel_path), .root = root};
+    append_one(watches, watch);
+
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(dir)) != NULL) {
+        if ((strcmp(de->d_name, ".") == 0) || (strcmp(de->d_name, "..") == 0)) {
+            continue;
+        }
+        char child_path[strlen(path) + strlen(de->d_name) + 2];
+        char child_rel[strlen(rel_path) + strlen(de->d_name) + 2];
+        sprintf(child_path, "%s/%s", path, de->d_name);
+        sprintf(child_rel, "%s%s%s", rel_path, rel_path[0] == '\0' ? "" : "/", de->d_name);
+        struct stat st;
+        if (lstat(child_path, &st) < 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+        if (!matches_any(&args.excludes, child_rel, de->d_name)) {
+            watch_dirs(inotify_fd, watches, child_path, child_rel, root);
+        }
+    }
+    closedir(dir);
+}
+
+Watch *find_watch(Watches *watches, int wd) {
+    for (size_t i = 0; i < watches->len; ++i) {
+        if (watches->items[i].wd == wd) {
+            return &watches->items[i];
+        }
+    }
+    return NULL;
+}
+
+//Drops the parsed file at [path], or every file below it if it is a directory
+void forget_files(ScanJobs *files, const char *path) {
+    size_t len = strlen(path);
+    size_t kept = 0;
+    for (size_t i = 0; i < files->len; ++i) {
+        ScanJob *job = files->items[i];
+        if (strncmp(job->path, path, len) == 0 && (job->path[len] == '\0' || job->path[len] == '/')) {
+            free_scan_job(job);
+        } else {
+            files->items[kept++] = job;
+        }
+    }
+    files->len = kept;
+}
+
+bool contains_path(Cmd *paths, const char *path) {
+    for (size_t i = 0; i < paths->len; ++i) {
+        if (strcmp(paths->items[i], path) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void add_unique(Cmd *paths, const char *path) {
+    if (!contains_path(paths, path)) {
+        append_one(paths, strdup(path));
+    }
+}
+
+//Reads a burst of inotify events, until nothing happened for DEBOUNCE_MS.
+//Test files that were written, moved or deleted end up in [changed], new 
+//directories are watched and scanned right away.
+int collect_changes(int inotify_fd, Watches *watches, Cmd *changed) {
+    char buf[DEFAULT_CAP*16] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int defin_changed = 0;
+    struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+    int timeout = -1;
+    while (poll(&pfd, 1, timeout) > 0) {
+        timeout = DEBOUNCE_MS;
+        ssize_t n = read(inotify_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            break;
+        }
+        for (char *p = buf; p < buf + n; ) {
+            struct inotify_event *event = (struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + event->len;
+            Watch *watch = find_watch(watches, event->wd);
+            if (watch != NULL && (event->mask & IN_IGNORED)) {
+                //directory is gone, so is its watch
+                free(watch->path);
+                free(watch->rel_path);
+                *watch = watches->items[--watches->len];
+                continue;
+            }
+            if (watch == NULL || event->len == 0) {
+                continue;
+            }
+            char path[strlen(watch->path) + event->len + 2];
+            char rel_path[strlen(watch->rel_path) + event->len + 2];
+            sprintf(path, "%s/%s", watch->path, event->name);
+            sprintf(rel_path, "%s%s%s", watch->rel_path, watch->rel_path[0] == '\0' ? "" : "/", event->name);
+
+            if (event->mask & IN_ISDIR) {
+                if (matches_any(&args.excludes, rel_path, event->name)) {
+                    continue;
+                }
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    //watch is invalid after this, watches may grow
+                    size_t root = watch->root;
+                    watch_dirs(inotify_fd, watches, path, rel_path, root);
+                }
+                add_unique(changed, path);
+            } else if (strcmp(event->name, DEFIN_FILE) == 0 && watch->rel_path[0] == '\0') {
+                defin_changed = 1;
+            } else if (wants_file(rel_path, event->name)) {
+                add_unique(changed, path);
+            }
+        }
+    }
+    return defin_changed;
+}
+
+size_t root_of(const char *path) {
+    for (size_t root = 0; root < args.dirs.len; ++root) {
+        size_t len = strlen(args.dirs.items[root]);
+        if (strncmp(path, args.dirs.items[root], len) == 0 && path[len] == '/') {
+            return root;
+        }
+    }
+    return 0;
+}
+
+//Reparses the changed paths. Files that are gone are forgotten, directories
+//are walked for test files. Returns the test files still around.
+void reparse_changes(ScanJobs *files, Cmd *changed, Cmd *still_there) {
+    ScanQueue queue = {0};
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.found, NULL);
+    for (size_t i = 0; i < changed->len; ++i) {
+        char *path = changed->items[i];
+        forget_files(files, path);
+        struct stat st;
+        if (stat(path, &st) < 0) {
+            printf(LOG_PREFIX" '%s' is gone\n", path);
+            continue;
+        }
+        size_t root = root_of(path);
+        if (S_ISDIR(st.st_mode)) {
+            int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            const char *rel_path = path + strlen(args.dirs.items[root]) + 1;
+            if (fd >= 0) {
+                walk_dir(&queue, fd, path, rel_path, root, NULL);
+            }
+        } else {
+            push_scan_job(&queue, path, root);
+        }
+    }
+    //workers are overkill for a handful of files
+    scan_worker(&queue);
+    for (size_t i = 0; i < queue.len; ++i) {
+        //a new directory and a file in it may both have been queued
+        if (contains_path(still_there, queue.items[i]->path)) {
+            free_scan_job(queue.items[i]);
+            continue;
+        }
+        append_one(still_there, strdup(queue.items[i]->path));
+        append_one(files, queue.items[i]);
+    }
+    qsort(files->items, files->len, sizeof(ScanJob*), cmp_scan_job);
+    free(queue.items);
+    pthread_cond_destroy(&queue.found);
+    pthread_mutex_destroy(&queue.lock);
+}
+
+char* reread_defines() {
+    char* defines = NULL;
+    for (size_t root = 0; root < args.dirs.len; ++root) {
+        char path[strlen(args.dirs.items[root]) + strlen(DEFIN_FILE) + 2];
+        sprintf(path, "%s/%s", args.dirs.items[root], DEFIN_FILE);
+        if (access(path, R_OK) == 0) {
+            append_defines(&defines, read_defin(args.dirs.items[root], DEFIN_FILE));
+        }
+    }
+    return defines;
+}
+
+void free_paths(Cmd *paths) {
+    for (size_t i = 0; i < paths->len; ++i) {
+        free(paths->items[i]);
+    }
+    paths->len = 0;
+}
+
+//The persistent runner of --watch, see toast_host
+typedef struct {
+    pid_t pid;
+    int cmd_fd;
+    int out_fd;
+    int status_fd;
+    char path[PATH_CAP];
+} Host;
+
+void stop_host(Host *host) {
+    if (host->pid <= 0) {
+        return;
+    }
+    close(host->cmd_fd);
+    kill(host->pid, SIGKILL);
+    waitpid(host->pid, NULL, 0);
+    close(host->out_fd);
+    close(host->status_fd);
+    host->pid = 0;
+}
+
+int start_host(Host *host, const char *path) {
+    int cmd[2], status[2];
+    if (pipe2(cmd, O_CLOEXEC) < 0) {
+        return 1;
+    }
+    if (pipe2(status, O_CLOEXEC) < 0) {
+        close(cmd[0]);
+        close(cmd[1]);
+        return 1;
+    }
+    pid_t pid = fork_piped(&host->out_fd);
+    if (pid == 0) {
+        if (dup2(cmd[0], STDIN_FILENO) < 0 || dup2(status[1], HOST_STATUS_FD) < 0) {
+            exit(1);
+        }
+        //dup2 onto itself keeps close-on-exec
+        if (status[1] == HOST_STATUS_FD) {
+            fcntl(HOST_STATUS_FD, F_SETFD, 0);
+        }
+        execl(path, path, (char*)NULL);
+        exit(127);
+    }
+    close(cmd[0]);
+    close(status[1]);
+    if (pid < 0) {
+        close(cmd[1]);
+        close(status[0]);
+        return 1;
+    }
+    host->pid = pid;
+    host->cmd_fd = cmd[1];
+    host->status_fd = status[0];
+    snprintf(host->path, sizeof(host->path), "%s", path);
+    return 0;
+}
+
+//Has the runner at [host_path] run [modules]. It stays around between runs, 
+//only modules that changed since the last run are loaded again.
+int run_hot(Host *host, const char *host_path, Units *modules, Cmd *only_files) {
+    if (host->pid > 0 && (strcmp(host->path, host_path) != 0 || waitpid(host->pid, NULL, WNOHANG) != 0)) {
+        stop_host(host);
+    }
+    if (host->pid <= 0 && start_host(host, host_path) != 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] starting the test runner failed (%s)\n", strerror(errno));
+        return 1;
+    }
+    printf(LOG_PREFIX " Running test suite\n");
+    Cmd runner_args = {0};
+    append_runner_args(&runner_args, only_files);
+    Str cmds = {0};
+    char line[PATH_CAP + 64];
+    for (size_t i = 0; i < modules->len; ++i) {
+        int n = snprintf(line, sizeof(line), "module %s toast_register_%016llx\n", 
+                modules->items[i].obj, (unsigned long long)modules->items[i].reg_id);
+        append_many(&cmds, line, n);
+    }
+    for (size_t i = 0; i < runner_args.len; ++i) {
+        append_many(&cmds, "arg ", 4);
+        append_many(&cmds, runner_args.items[i], strlen(runner_args.items[i]));
+        append_one(&cmds, '\n');
+    }
+    append_many(&cmds, "run\n", 4);
+    ssize_t written = write(host->cmd_fd, cmds.items, cmds.len);
+    str_free(cmds);
+    free(runner_args.items);
+    if (written < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] the test runner went away (%s)\n", strerror(errno));
+        stop_host(host);
+        return 1;
+    }
+    if (relay_output(host->out_fd, host->status_fd, suite_deadline())) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] test suite is still running %dms after its timeout, killing it\n", SUITE_GRACE_MS);
+        stop_host(host);
+    }
+    return 0;
+}
+
+//Keeps toaster around and reruns the cases of test files as they change.
+//Only units whose source changed are compiled again, and only slices from the
+//changed files are run, unless defin.test.c changed. Test files are loaded 
+//into a runner that stays around, as shared objects.
+int watch_sources(ScanJobs *files, char** defines) {
+    //a runner that went away is noticed by its pipes
+    signal(SIGPIPE, SIG_IGN);
+    int inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+    if (inotify_fd < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] could not start watching because: %s\n", strerror(errno));
+        return 1;
+    }
+    Watches watches = {0};
+    for (size_t root = 0; root < args.dirs.len; ++root) {
+        watch_dirs(inotify_fd, &watches, args.dirs.items[root], "", root);
+    }
+
+    Cmd changed = {0};
+    Cmd still_there = {0};
+    Cases cases = {0};
+    Units modules = {0};
+    Host host = {0};
+    Cmd *only_files = NULL;
+    uint64_t start = now_ns();
+    while (1) {
+        collect_cases(files, &cases);
+        char host_path[PATH_CAP];
+        if (build_test_suite(&cases, *defines, host_path, &modules) == 0) {
+            printf(LOG_PREFIX" Rebuilt in %.3fms\n", (now_ns() - start)/1e6);
+            start = now_ns();
+            run_hot(&host, host_path, &modules, only_files);
+            printf(LOG_PREFIX" Ran in %.3fms\n", (now_ns() - start)/1e6);
+        }
+        if (args.stats) {
+            print_memory(files);
+        }
+        //wait for a change that is worth a rebuild
+        int defin_changed = 0;
+        do {
+            printf(LOG_PREFIX" Watching %ld directories for changes\n", watches.len);
+            fflush(stdout);
+            free_paths(&changed);
+            free_paths(&still_there);
+            defin_changed = collect_changes(inotify_fd, &watches, &changed);
+            if (changed.len == 0 && !defin_changed) {
+                continue;
             }
-            printf(LOG_PREFIX " Running test suite\n");
-            char* cmd[] = {"./tmp_toast"};
-            execvp(cmd[0], cmd);
-       }
-
-       if (pid > 0) {
-           wait(&status);
-           off_t fsize = lseek(log_fd, 0, SEEK_END);
-           char log_buf[fsize+1];
-           lseek(log_fd, 0, SEEK_SET);
-           read(log_fd, log_buf, fsize);
-           log_buf[fsize] = '\0';
-           printf("%s", log_buf);
-           close(log_fd);
-           if (args.keep == 0) {
-               if (remove_generated_files(0) != 0) {
-                   return 1;
-               }
-           }
-       }
-       return 0;
-   }
-   return 1;
+            start = now_ns();
+            reparse_changes(files, &changed, &still_there);
+            if (defin_changed) {
+                free(*defines);
+                *defines = reread_defines();
+            }
+        } while (still_there.len == 0 && !defin_changed);
+        only_files = defin_changed ? NULL : &still_there;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    parse_args(argc, argv);
+    set_toolchain();
+    ScanJobs files = {0};
+    char* defines = NULL;
+    if (discover_files(&files, &defines) != 0) {
+        exit(1);
+    }
+    Cases cases = {0};
+    collect_cases(&files, &cases);
+    if (args.stats) {
+        print_memory(&files);
+    }
+
+    if (mkdir_p(args.cache_dir) < 0) {
+        fprintf(stderr, LOG_PREFIX"[ERROR] creating cache dir '%s' failed (%s)\n", args.cache_dir, strerror(errno));
+        return 1;
+    }
+    if (args.watch) {
+        return watch_sources(&files, &defines);
+    }
+    char bin_path[PATH_CAP];
+    int failed = build_test_suite(&cases, defines, bin_path, NULL);
+    free_cases(cases);
+    if (failed == 0) {
+        failed = run_test_suite(bin_path, NULL);
+    }
+    if (args.stats) {
+        print_memory(&files);
+    }
+    for (size_t i = 0; i < files.len; ++i) {
+        free_scan_job(files.items[i]);
+    }
+    free(files.items);
+    free(defines);
+    return failed;
 }